@@ -8,10 +8,270 @@
 #define __TDynamicMatrix_H__
 #include <iostream>
 #include <cassert>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <cstdint>
+#include <type_traits>
+#include <bitset>
+#include <cstring>
+#include <atomic>
+#include <utility>
+#include <memory>
+#include <new>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <optional>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <fstream>
+#include <charconv>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 const int MAX_VECTOR_SIZE = 100000000;
 const int MAX_MATRIX_SIZE = 10000;
+
+// Параллельное выполнение
+// Диапазон [begin, end) делится на непрерывные части по числу потоков,
+// f(lo, hi) вызывается для каждой части. cost - оценка числа операций
+// на один элемент диапазона: малые задачи выполняются в текущем потоке.
+const size_t PARALLEL_MIN_WORK = 1 << 16;
+
+inline size_t& thread_count_ref() noexcept
+{
+    static size_t n = max<size_t>(1, thread::hardware_concurrency());
+    return n;
+}
+inline size_t thread_count() noexcept
+{
+    return thread_count_ref();
+}
+// задается до начала вычислений; 0 - число аппаратных потоков
+inline void set_thread_count(size_t n) noexcept
+{
+    thread_count_ref() = n ? n : max<size_t>(1, thread::hardware_concurrency());
+}
+// true внутри части, выполняемой parallel_for: вложенные вызовы идут в
+// текущем потоке, иначе число потоков растет как thread_count()^2
+inline bool& in_parallel_ref() noexcept
+{
+    thread_local bool inside = false;
+    return inside;
+}
+struct TParallelRegion
+{
+    bool outer;
+    TParallelRegion() noexcept : outer(in_parallel_ref()) { in_parallel_ref() = true; }
+    ~TParallelRegion() { in_parallel_ref() = outer; }
+};
+
+template<typename F>
+void parallel_for(size_t begin, size_t end, F f, size_t cost = 1)
+{
+    if (begin >= end) {
+        return;
+    }
+    size_t len = end - begin;
+    size_t nt = min(thread_count(), len);
+    nt = min(nt, max<size_t>(1, len * cost / PARALLEL_MIN_WORK));
+    if (nt <= 1 || in_parallel_ref()) {
+        f(begin, end);
+        return;
+    }
+    std::vector<thread> workers;
+    std::vector<exception_ptr> errors(nt);
+    size_t chunk = (len + nt - 1) / nt;
+    for (size_t t = 1; t < nt; t++) {
+        size_t lo = begin + t * chunk, hi = min(end, lo + chunk);
+        if (lo >= hi) {
+            break;
+        }
+        workers.emplace_back([&f, &errors, t, lo, hi]() {
+            TParallelRegion region;
+            try {
+                f(lo, hi);
+            }
+            catch (...) {
+                errors[t] = current_exception();
+            }
+        });
+    }
+    try {
+        TParallelRegion region;
+        f(begin, min(end, begin + chunk));
+    }
+    catch (...) {
+        errors[0] = current_exception();
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    for (auto& e : errors) {
+        if (e) {
+            rethrow_exception(e);
+        }
+    }
+}
+// Сравнение массивов
+// Целые типы сравниваются memcmp, вещественные - с допуском TTolerance:
+// a и b равны, если |a - b| <= abs_tol, или |a - b| <= rel_tol * max(|a|, |b|),
+// или между ними не более ulps представимых значений. NaN не равен ничему,
+// бесконечности равны только себе. По умолчанию - 4 ULP.
+struct TTolerance
+{
+    double abs_tol;
+    double rel_tol;
+    uint64_t ulps;
+    TTolerance(double a = 0, double r = 0, uint64_t u = 4) : abs_tol(a), rel_tol(r), ulps(u) {}
+};
+
+// порядковый номер вещественного числа среди представимых значений
+template<typename T>
+int64_t float_order(T x) noexcept
+{
+    typedef typename conditional<sizeof(T) == 4, int32_t, int64_t>::type bits_t;
+    bits_t b;
+    memcpy(&b, &x, sizeof(b));
+    return b < 0 ? (int64_t)numeric_limits<bits_t>::min() - (int64_t)b : (int64_t)b;
+}
+
+template<typename T>
+bool approx_equal_elem(T a, T b, const TTolerance& tol) noexcept
+{
+    if (a == b)
+        return true;
+    if constexpr (is_integral<T>::value) {
+        return false; // целые сравниваются точно
+    }
+    else {
+        if (!(std::isfinite(a) && std::isfinite(b)))
+            return false;
+        T d = std::abs(a - b), m = max(std::abs(a), std::abs(b));
+        if (d <= tol.abs_tol || d <= tol.rel_tol * m)
+            return true;
+        if (sizeof(T) == 4 || sizeof(T) == 8) {
+            int64_t oa = float_order(a), ob = float_order(b);
+            return (uint64_t)(oa > ob ? oa - ob : ob - oa) <= tol.ulps;
+        }
+        return d <= tol.ulps * numeric_limits<T>::epsilon() * m;
+    }
+}
+
+// последовательное сравнение блоками по EQUAL_BLOCK элементов с досрочным
+// выходом между блоками. Целые сравниваются memcmp. У вещественных блок
+// сначала сравнивается точно циклом без ветвлений (векторизуется), и только
+// блок с несовпадениями проверяется поэлементно с допуском.
+const size_t EQUAL_BLOCK = 1024;
+
+template<typename T>
+bool equal_block(const T* a, const T* b, size_t n, const TTolerance& tol) noexcept
+{
+    if constexpr (is_integral<T>::value) {
+        (void)tol;
+        return memcmp(a, b, n * sizeof(T)) == 0;
+    }
+    else {
+        for (size_t i0 = 0; i0 < n; i0 += EQUAL_BLOCK) {
+            size_t i1 = min(n, i0 + EQUAL_BLOCK);
+            bool same = true;
+            for (size_t i = i0; i < i1; i++) {
+                same &= a[i] == b[i];
+            }
+            if (same)
+                continue;
+            for (size_t i = i0; i < i1; i++) {
+                if (!approx_equal_elem(a[i], b[i], tol))
+                    return false;
+            }
+        }
+        return true;
+    }
+}
+
+// параллельное сравнение: потоки проверяют общий флаг несовпадения
+// между блоками и прекращают работу, как только он установлен
+template<typename T>
+bool equal_array(const T* a, const T* b, size_t n, const TTolerance& tol = TTolerance())
+{
+    atomic<bool> differ(false);
+    size_t blocks = (n + EQUAL_BLOCK - 1) / EQUAL_BLOCK;
+    parallel_for(0, blocks, [&](size_t lo, size_t hi) {
+        for (size_t q = lo; q < hi && !differ.load(memory_order_relaxed); q++) {
+            size_t i0 = q * EQUAL_BLOCK, i1 = min(n, i0 + EQUAL_BLOCK);
+            if (!equal_block(a + i0, b + i0, i1 - i0, tol))
+                differ.store(true, memory_order_relaxed);
+        }
+    }, EQUAL_BLOCK);
+    return !differ.load();
+}
+
+// Политики выполнения поэлементных операций (map, zip, transform):
+// seq - обычный цикл, unseq - цикл с указанием компилятору, что итерации
+// независимы (векторизация), par - unseq в нескольких потоках
+enum class TExecution { seq, unseq, par };
+
+#if defined(__clang__)
+#define TMATRIX_IVDEP _Pragma("clang loop vectorize(assume_safety)")
+#elif defined(__GNUC__)
+#define TMATRIX_IVDEP _Pragma("GCC ivdep")
+#elif defined(_MSC_VER)
+#define TMATRIX_IVDEP __pragma(loop(ivdep))
+#else
+#define TMATRIX_IVDEP
+#endif
+
+const size_t ELEMENTWISE_COST = 4;
+
+// g(i) для i из [0, n)
+template<typename G>
+void elementwise(size_t n, TExecution ex, G g)
+{
+    auto run = [&](size_t lo, size_t hi) {
+        if (ex == TExecution::seq) {
+            for (size_t i = lo; i < hi; i++)
+                g(i);
+        }
+        else {
+            TMATRIX_IVDEP
+            for (size_t i = lo; i < hi; i++)
+                g(i);
+        }
+    };
+    if (ex == TExecution::par)
+        parallel_for(0, n, run, ELEMENTWISE_COST);
+    else
+        run(0, n);
+}
+
+// row(i, inner) для каждой строки; при par строки делятся между потоками,
+// внутри строки - unseq
+template<typename G>
+void elementwise_rows(size_t rows, size_t len, TExecution ex, G row)
+{
+    TExecution inner = (ex == TExecution::seq) ? TExecution::seq : TExecution::unseq;
+    auto run = [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++)
+            row(i, inner);
+    };
+    if (ex == TExecution::par)
+        parallel_for(0, rows, run, len * ELEMENTWISE_COST);
+    else
+        run(0, rows);
+}
+
 // Динамический вектор - 
 // шаблонный вектор на динамической памяти
 template<typename T>
@@ -20,6 +280,7 @@ class TDynamicVector
 protected:
     size_t sz;
     T* pMem;
+    shared_ptr<void> hold; // непуст у представления: владелец чужой памяти pMem
 public:
     TDynamicVector(size_t size = 1) : sz(size)
     {
@@ -41,21 +302,31 @@ public:
         pMem = new T[sz];
         std::copy(arr, arr + sz, pMem);
     }
+    // представление над чужой памятью mem; память живет, пока жив keep
+    TDynamicVector(T* mem, size_t s, shared_ptr<void> keep) : sz(s), pMem(mem), hold(std::move(keep))
+    {
+        assert(mem != nullptr && hold && "TDynamicVector view requires memory and its owner");
+        if (sz == 0)
+            throw out_of_range("Vector size should be greater than zero");
+        if (sz > MAX_VECTOR_SIZE) {
+            throw length_error("Vector size is too large");
+        }
+    }
     TDynamicVector(const TDynamicVector& v)
     {
         sz = v.sz;
         pMem = new T[sz];
         std::copy(v.pMem, v.pMem + sz, pMem);
     }
-    TDynamicVector(TDynamicVector&& v) noexcept
+    TDynamicVector(TDynamicVector&& v) noexcept : sz(0), pMem(nullptr)
     {
-        pMem = nullptr;
         swap(*this, v);
     }
     ~TDynamicVector()
     {
         sz = 0;
-        delete[] pMem;
+        if (!hold)
+            delete[] pMem;
         pMem = nullptr;
     }
     TDynamicVector& operator=(const TDynamicVector& v)
@@ -66,19 +337,34 @@ public:
         if (sz != v.sz) {
             sz = v.sz;
             T* buf = new T[sz];
-            delete[] pMem;
+            if (!hold)
+                delete[] pMem;
+            hold.reset();
             pMem = buf;
         }
         std::copy(v.pMem, v.pMem + sz, pMem);
         return *this;
     }
+    // представление того же размера сохраняет свою память: элементы
+    // переносятся в нее (запись в отображенный файл и т.п.), v остается пустым
     TDynamicVector& operator=(TDynamicVector&& v) noexcept
     {
-        swap(*this, v);
+        if (hold && sz == v.sz && &v != this) {
+            std::move(v.pMem, v.pMem + sz, pMem);
+            TDynamicVector released(std::move(v));
+        }
+        else {
+            swap(*this, v);
+        }
         return *this;
     }
 
     size_t size() const noexcept { return sz; }
+    bool is_view() const noexcept { return bool(hold); }
+
+    // непрерывная память элементов
+    T* data() noexcept { return pMem; }
+    const T* data() const noexcept { return pMem; }
 
     // индексация
     T& operator[](size_t ind)
@@ -108,20 +394,11 @@ public:
     }
 
     // сравнение
-    bool operator==(const TDynamicVector& v) const noexcept
+    bool operator==(const TDynamicVector& v) const
     {
-        if (sz != v.sz) return false;
-
-        T eps = numeric_limits<T>::epsilon();
-
-        for (int i = 0; i < sz; i++) {
-            if (abs(pMem[i] - v[i]) > eps) {
-                return 0;
-            }
-        }
-        return 1;
+        return sz == v.sz && equal_array(pMem, v.pMem, sz);
     }
-    bool operator!=(const TDynamicVector& v) const noexcept
+    bool operator!=(const TDynamicVector& v) const
     {
         return !(*this == v);
     }
@@ -188,10 +465,44 @@ public:
         return res;
     }
 
+    // поэлементные операции над непрерывной памятью
+    template<typename F>
+    auto map(F f, TExecution ex = TExecution::unseq) const
+        -> TDynamicVector<typename decay<decltype(f(declval<T>()))>::type>
+    {
+        TDynamicVector<typename decay<decltype(f(declval<T>()))>::type> res(sz);
+        auto* r = res.data();
+        const T* a = pMem;
+        elementwise(sz, ex, [&](size_t i) { r[i] = f(a[i]); });
+        return res;
+    }
+    template<typename U, typename F>
+    auto zip(const TDynamicVector<U>& v, F f, TExecution ex = TExecution::unseq) const
+        -> TDynamicVector<typename decay<decltype(f(declval<T>(), declval<U>()))>::type>
+    {
+        if (sz != v.size()) {
+            throw length_error("different vector sizes");
+        }
+        TDynamicVector<typename decay<decltype(f(declval<T>(), declval<U>()))>::type> res(sz);
+        auto* r = res.data();
+        const T* a = pMem;
+        const U* b = v.data();
+        elementwise(sz, ex, [&](size_t i) { r[i] = f(a[i], b[i]); });
+        return res;
+    }
+    template<typename F>
+    TDynamicVector& transform(F f, TExecution ex = TExecution::unseq)
+    {
+        T* a = pMem;
+        elementwise(sz, ex, [&](size_t i) { a[i] = f(a[i]); });
+        return *this;
+    }
+
     friend void swap(TDynamicVector& lhs, TDynamicVector& rhs) noexcept
     {
         std::swap(lhs.sz, rhs.sz);
         std::swap(lhs.pMem, rhs.pMem);
+        lhs.hold.swap(rhs.hold);
     }
 
     // ввод/вывод
@@ -216,6 +527,7 @@ class TDynamicMatrix : private TDynamicVector<TDynamicVector<T>>
 {
     using TDynamicVector<TDynamicVector<T>>::pMem;
     using TDynamicVector<TDynamicVector<T>>::sz;
+    shared_ptr<void> storage; // непуст у представления: владелец памяти строк
 public:
     TDynamicMatrix(size_t s = 1) : TDynamicVector<TDynamicVector<T>>(s)
     {
@@ -223,20 +535,102 @@ public:
         for (size_t i = 0; i < sz; i++)
             pMem[i] = TDynamicVector<T>(sz);
     }
+    // представление над чужой памятью mem из s * s элементов по строкам
+    TDynamicMatrix(T* mem, size_t s, shared_ptr<void> keep) : TDynamicVector<TDynamicVector<T>>(s)
+    {
+        if (sz > MAX_MATRIX_SIZE) throw length_error("bad matrix size");
+        for (size_t i = 0; i < sz; i++)
+            pMem[i] = TDynamicVector<T>(mem + i * sz, sz, keep);
+        storage = std::move(keep);
+    }
 
     using TDynamicVector<TDynamicVector<T>>::operator[];
     using TDynamicVector<TDynamicVector<T>>::at;
     using TDynamicVector<TDynamicVector<T>>::size;
+    bool is_view() const noexcept { return bool(storage); }
+
+    // копия всегда владеет своей памятью
+    TDynamicMatrix(const TDynamicMatrix& m) : TDynamicVector<TDynamicVector<T>>(m) {}
+    TDynamicMatrix(TDynamicMatrix&&) noexcept = default;
+    TDynamicMatrix& operator=(const TDynamicMatrix& m)
+    {
+        if (&m != this) {
+            bool keep = is_view() && sz == m.sz;
+            TDynamicVector<TDynamicVector<T>>::operator=(m);
+            if (!keep)
+                storage.reset();
+        }
+        return *this;
+    }
+    // как у вектора: представление того же порядка получает элементы,
+    // m остается пустой
+    TDynamicMatrix& operator=(TDynamicMatrix&& m) noexcept
+    {
+        if (&m == this) {
+            return *this;
+        }
+        if (sz == m.sz && is_view()) {
+            for (size_t i = 0; i < sz; i++) {
+                std::move(m.pMem[i].data(), m.pMem[i].data() + sz, pMem[i].data());
+            }
+            TDynamicMatrix released(std::move(m));
+        }
+        else {
+            swap(*this, m);
+        }
+        return *this;
+    }
+    friend void swap(TDynamicMatrix& lhs, TDynamicMatrix& rhs) noexcept
+    {
+        swap(static_cast<TDynamicVector<TDynamicVector<T>>&>(lhs), static_cast<TDynamicVector<TDynamicVector<T>>&>(rhs));
+        lhs.storage.swap(rhs.storage);
+    }
+
+    // поэлементные операции, строки обрабатываются через их память
+    template<typename F>
+    auto map(F f, TExecution ex = TExecution::unseq) const
+        -> TDynamicMatrix<typename decay<decltype(f(declval<T>()))>::type>
+    {
+        TDynamicMatrix<typename decay<decltype(f(declval<T>()))>::type> res(sz);
+        elementwise_rows(sz, sz, ex, [&](size_t i, TExecution inner) {
+            auto* r = res[i].data();
+            const T* a = pMem[i].data();
+            elementwise(sz, inner, [&](size_t j) { r[j] = f(a[j]); });
+        });
+        return res;
+    }
+    template<typename U, typename F>
+    auto zip(const TDynamicMatrix<U>& m, F f, TExecution ex = TExecution::unseq) const
+        -> TDynamicMatrix<typename decay<decltype(f(declval<T>(), declval<U>()))>::type>
+    {
+        if (sz != m.size()) {
+            throw length_error("different matrix sizes");
+        }
+        TDynamicMatrix<typename decay<decltype(f(declval<T>(), declval<U>()))>::type> res(sz);
+        elementwise_rows(sz, sz, ex, [&](size_t i, TExecution inner) {
+            auto* r = res[i].data();
+            const T* a = pMem[i].data();
+            const U* b = m[i].data();
+            elementwise(sz, inner, [&](size_t j) { r[j] = f(a[j], b[j]); });
+        });
+        return res;
+    }
+    template<typename F>
+    TDynamicMatrix& transform(F f, TExecution ex = TExecution::unseq)
+    {
+        elementwise_rows(sz, sz, ex, [&](size_t i, TExecution inner) {
+            T* a = pMem[i].data();
+            elementwise(sz, inner, [&](size_t j) { a[j] = f(a[j]); });
+        });
+        return *this;
+    }
 
     // сравнение
-    bool operator==(const TDynamicMatrix& m) const noexcept
+    bool operator==(const TDynamicMatrix& m) const
     {
-        for (size_t i = 0; i < sz; i++)
-            if (pMem[i] != m[i])
-                return 0;
-        return 1;
+        return approx_equal(*this, m, TTolerance());
     }
-    bool operator!=(const TDynamicMatrix& m) const noexcept
+    bool operator!=(const TDynamicMatrix& m) const
     {
         return !(*this == m);
     }
@@ -291,15 +685,7 @@ public:
         if (sz != m.sz) {
             throw length_error("different matrix sizes");
         }
-        TDynamicMatrix<T> res(sz);
-        for (int i = 0; i < sz; i++) {
-            for (int j = 0; j < sz; j++) {
-                for (int k = 0; k < sz; k++) {
-                    res[i][j] += pMem[i][k] * m[k][j];
-                }
-            }
-        }
-        return res;
+        return gemm(*this, m);
     }
 
     // ввод/вывод
@@ -313,9 +699,4738 @@ public:
     friend ostream& operator<<(ostream& ostr, const TDynamicMatrix& v)
     {
         for (size_t i = 0; i < v.sz; i++) {
-            ostr << v[i] << std::endl;
+            ostr << v[i] << '\n';
+        }
+
+        return ostr;
+    }
+};
+
+// Сравнение с допуском
+template<typename T>
+bool approx_equal(const TDynamicVector<T>& a, const TDynamicVector<T>& b, const TTolerance& tol)
+{
+    return a.size() == b.size() && equal_array(a.data(), b.data(), a.size(), tol);
+}
+
+// строки матрицы распределяются по потокам, каждая сравнивается блоками
+template<typename T>
+bool approx_equal(const TDynamicMatrix<T>& a, const TDynamicMatrix<T>& b, const TTolerance& tol)
+{
+    size_t n = a.size();
+    if (b.size() != n)
+        return false;
+    atomic<bool> differ(false);
+    parallel_for(0, n, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi && !differ.load(memory_order_relaxed); i++) {
+            if (!equal_block(a[i].data(), b[i].data(), n, tol))
+                differ.store(true, memory_order_relaxed);
+        }
+    }, n);
+    return !differ.load();
+}
+
+// Отчет о расхождениях
+// Позиции - линейные индексы (для матрицы i * n + j). Расхождение
+// определяется тем же допуском, что и approx_equal; максимальные
+// погрешности считаются по всем элементам.
+const size_t DIFF_NPOS = size_t(-1);
+
+struct TDiffReport
+{
+    size_t count;      // число расхождений
+    size_t first;      // первое расхождение, DIFF_NPOS если их нет
+    double max_abs;    // max |a - b|
+    size_t max_abs_pos;
+    double max_rel;    // max |a - b| / max(|a|, |b|)
+    size_t max_rel_pos;
+
+    TDiffReport() : count(0), first(DIFF_NPOS), max_abs(0), max_abs_pos(DIFF_NPOS), max_rel(0), max_rel_pos(DIFF_NPOS) {}
+
+    bool equal() const noexcept { return count == 0; }
+
+    // объединение отчетов по соседним частям данных, other - после this
+    void merge(const TDiffReport& other) noexcept
+    {
+        count += other.count;
+        if (first == DIFF_NPOS)
+            first = other.first;
+        if (other.max_abs > max_abs) {
+            max_abs = other.max_abs;
+            max_abs_pos = other.max_abs_pos;
+        }
+        if (other.max_rel > max_rel) {
+            max_rel = other.max_rel;
+            max_rel_pos = other.max_rel_pos;
+        }
+    }
+};
+
+template<typename T>
+void diff_block(const T* a, const T* b, size_t n, size_t base, const TTolerance& tol, TDiffReport& rep) noexcept
+{
+    for (size_t i = 0; i < n; i++) {
+        bool same = is_integral<T>::value ? a[i] == b[i] : approx_equal_elem(a[i], b[i], tol);
+        if (!same) {
+            if (rep.first == DIFF_NPOS)
+                rep.first = base + i;
+            rep.count++;
+        }
+        double x = (double)a[i], y = (double)b[i];
+        double d = std::abs(x - y), m = max(std::abs(x), std::abs(y));
+        if (d > rep.max_abs) {
+            rep.max_abs = d;
+            rep.max_abs_pos = base + i;
+        }
+        if (m > 0 && d / m > rep.max_rel) {
+            rep.max_rel = d / m;
+            rep.max_rel_pos = base + i;
+        }
+    }
+}
+
+template<typename T>
+TDiffReport diff(const TDynamicVector<T>& a, const TDynamicVector<T>& b, const TTolerance& tol = TTolerance())
+{
+    if (a.size() != b.size())
+        throw length_error("different vector sizes");
+    size_t n = a.size(), blocks = (n + EQUAL_BLOCK - 1) / EQUAL_BLOCK;
+    std::vector<TDiffReport> part(blocks);
+    parallel_for(0, blocks, [&](size_t lo, size_t hi) {
+        for (size_t q = lo; q < hi; q++) {
+            size_t i0 = q * EQUAL_BLOCK, i1 = min(n, i0 + EQUAL_BLOCK);
+            diff_block(a.data() + i0, b.data() + i0, i1 - i0, i0, tol, part[q]);
+        }
+    }, EQUAL_BLOCK);
+    TDiffReport res;
+    for (const TDiffReport& p : part)
+        res.merge(p);
+    return res;
+}
+
+template<typename T>
+TDiffReport diff(const TDynamicMatrix<T>& a, const TDynamicMatrix<T>& b, const TTolerance& tol = TTolerance())
+{
+    if (a.size() != b.size())
+        throw length_error("different matrix sizes");
+    size_t n = a.size();
+    std::vector<TDiffReport> part(n);
+    parallel_for(0, n, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++)
+            diff_block(a[i].data(), b[i].data(), n, i * n, tol, part[i]);
+    }, n);
+    TDiffReport res;
+    for (const TDiffReport& p : part)
+        res.merge(p);
+    return res;
+}
+
+// Редукции
+// Данные делятся на блоки по REDUCE_BLOCK элементов (внутри строки матрицы),
+// блок суммируется в REDUCE_LANES независимых аккумуляторов, которые
+// компилятор раскладывает по векторным регистрам. В режиме reproducible
+// результаты блоков складываются деревом фиксированной формы, поэтому
+// результат не зависит от числа потоков; в режиме fast каждый поток
+// накапливает свою часть блоков, и части складываются по порядку.
+enum class TReduceMode { fast, reproducible };
+
+const size_t REDUCE_BLOCK = 4096;
+const size_t REDUCE_LANES = 8;
+
+// тип результата норм: вещественный для целых T
+template<typename T>
+using TReal = typename conditional<is_floating_point<T>::value, T, double>::type;
+
+template<typename R, typename T, typename F>
+R lane_sum(const T* p, size_t n, F f) noexcept
+{
+    R acc[REDUCE_LANES] = {};
+    size_t i = 0;
+    for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) {
+        for (size_t l = 0; l < REDUCE_LANES; l++) {
+            acc[l] += f(p[i + l]);
+        }
+    }
+    for (; i < n; i++) {
+        acc[i % REDUCE_LANES] += f(p[i]);
+    }
+    for (size_t w = REDUCE_LANES / 2; w > 0; w /= 2) {
+        for (size_t l = 0; l < w; l++) {
+            acc[l] += acc[l + w];
+        }
+    }
+    return acc[0];
+}
+
+// попарное сложение в фиксированном порядке
+template<typename R>
+R tree_sum(std::vector<R>& v) noexcept
+{
+    if (v.empty()) {
+        return R(0);
+    }
+    for (size_t w = 1; w < v.size(); w *= 2) {
+        for (size_t i = 0; i + w < v.size(); i += 2 * w) {
+            v[i] += v[i + w];
+        }
+    }
+    return v[0];
+}
+
+// сумма f(x) по rows строкам длины len, row(i) - начало строки
+template<typename R, typename T, typename G, typename F>
+R reduce_sum(size_t rows, size_t len, G row, F f, TReduceMode mode)
+{
+    size_t bpr = (len + REDUCE_BLOCK - 1) / REDUCE_BLOCK, blocks = rows * bpr;
+    auto block_sum = [&](size_t q) {
+        size_t i = q / bpr, j0 = (q % bpr) * REDUCE_BLOCK;
+        return lane_sum<R>(row(i) + j0, min(len - j0, REDUCE_BLOCK), f);
+    };
+    if (mode == TReduceMode::reproducible) {
+        std::vector<R> part(blocks);
+        parallel_for(0, blocks, [&](size_t lo, size_t hi) {
+            for (size_t q = lo; q < hi; q++) {
+                part[q] = block_sum(q);
+            }
+        }, min(len, REDUCE_BLOCK));
+        return tree_sum(part);
+    }
+    size_t nt = min(thread_count(), blocks), chunk = (blocks + nt - 1) / nt;
+    std::vector<R> part(nt, R(0));
+    parallel_for(0, nt, [&](size_t lo, size_t hi) {
+        for (size_t t = lo; t < hi; t++) {
+            for (size_t q = t * chunk; q < min(blocks, (t + 1) * chunk); q++) {
+                part[t] += block_sum(q);
+            }
+        }
+    }, chunk * min(len, REDUCE_BLOCK));
+    R s = R(0);
+    for (const R& p : part) {
+        s += p;
+    }
+    return s;
+}
+
+// экстремум f(x) и его линейный индекс; при равенстве - меньший индекс
+template<typename R>
+struct TExtremum
+{
+    R value;
+    size_t pos;
+};
+
+template<typename R, typename T, typename G, typename F, typename Less>
+TExtremum<R> reduce_extremum(size_t rows, size_t len, G row, F f, Less better)
+{
+    size_t bpr = (len + REDUCE_BLOCK - 1) / REDUCE_BLOCK, blocks = rows * bpr;
+    std::vector<TExtremum<R>> part(blocks);
+    parallel_for(0, blocks, [&](size_t lo, size_t hi) {
+        for (size_t q = lo; q < hi; q++) {
+            size_t i = q / bpr, j0 = (q % bpr) * REDUCE_BLOCK, j1 = min(len, j0 + REDUCE_BLOCK);
+            const T* p = row(i);
+            TExtremum<R> e = { f(p[j0]), i * len + j0 };
+            for (size_t j = j0 + 1; j < j1; j++) {
+                R x = f(p[j]);
+                if (better(x, e.value)) {
+                    e.value = x;
+                    e.pos = i * len + j;
+                }
+            }
+            part[q] = e;
         }
+    }, min(len, REDUCE_BLOCK));
+    TExtremum<R> res = part[0];
+    for (size_t q = 1; q < blocks; q++) {
+        if (better(part[q].value, res.value)) {
+            res = part[q];
+        }
+    }
+    return res;
+}
+
+// векторные редукции
+template<typename T>
+T sum(const TDynamicVector<T>& v, TReduceMode mode = TReduceMode::fast)
+{
+    return reduce_sum<T, T>(1, v.size(), [&](size_t) { return v.data(); },
+        [](T x) { return x; }, mode);
+}
+
+template<typename T>
+T norm1(const TDynamicVector<T>& v, TReduceMode mode = TReduceMode::fast)
+{
+    return reduce_sum<T, T>(1, v.size(), [&](size_t) { return v.data(); },
+        [](T x) { return x < T(0) ? T(-x) : x; }, mode);
+}
+
+template<typename T>
+TReal<T> norm2(const TDynamicVector<T>& v, TReduceMode mode = TReduceMode::fast)
+{
+    return std::sqrt(reduce_sum<TReal<T>, T>(1, v.size(), [&](size_t) { return v.data(); },
+        [](T x) { return TReal<T>(x) * TReal<T>(x); }, mode));
+}
+
+template<typename T>
+T norm_inf(const TDynamicVector<T>& v)
+{
+    return reduce_extremum<T, T>(1, v.size(), [&](size_t) { return v.data(); },
+        [](T x) { return x < T(0) ? T(-x) : x; }, [](T a, T b) { return a > b; }).value;
+}
+
+template<typename T>
+T min_value(const TDynamicVector<T>& v)
+{
+    return reduce_extremum<T, T>(1, v.size(), [&](size_t) { return v.data(); },
+        [](T x) { return x; }, [](T a, T b) { return a < b; }).value;
+}
+
+template<typename T>
+size_t argmax(const TDynamicVector<T>& v)
+{
+    return reduce_extremum<T, T>(1, v.size(), [&](size_t) { return v.data(); },
+        [](T x) { return x; }, [](T a, T b) { return a > b; }).pos;
+}
+
+template<typename T>
+T max_value(const TDynamicVector<T>& v)
+{
+    return v[argmax(v)];
+}
+
+// матричные редукции, позиции - линейные индексы i * n + j
+template<typename T>
+T sum(const TDynamicMatrix<T>& m, TReduceMode mode = TReduceMode::fast)
+{
+    return reduce_sum<T, T>(m.size(), m.size(), [&](size_t i) { return m[i].data(); },
+        [](T x) { return x; }, mode);
+}
+
+template<typename T>
+TReal<T> frobenius_norm(const TDynamicMatrix<T>& m, TReduceMode mode = TReduceMode::fast)
+{
+    return std::sqrt(reduce_sum<TReal<T>, T>(m.size(), m.size(), [&](size_t i) { return m[i].data(); },
+        [](T x) { return TReal<T>(x) * TReal<T>(x); }, mode));
+}
+
+// max по столбцам суммы модулей; столбцы делятся между потоками,
+// строки складываются по порядку
+template<typename T>
+T norm1(const TDynamicMatrix<T>& m)
+{
+    size_t n = m.size();
+    std::vector<T> col(n, T(0));
+    parallel_for(0, n, [&](size_t lo, size_t hi) {
+        for (size_t i = 0; i < n; i++) {
+            const T* r = m[i].data();
+            for (size_t j = lo; j < hi; j++) {
+                col[j] += r[j] < T(0) ? T(-r[j]) : r[j];
+            }
+        }
+    }, n);
+    return *std::max_element(col.begin(), col.end());
+}
+
+// max по строкам суммы модулей
+template<typename T>
+T norm_inf(const TDynamicMatrix<T>& m)
+{
+    size_t n = m.size();
+    std::vector<T> row(n);
+    parallel_for(0, n, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            row[i] = lane_sum<T>(m[i].data(), n, [](T x) { return x < T(0) ? T(-x) : x; });
+        }
+    }, n);
+    return *std::max_element(row.begin(), row.end());
+}
+
+template<typename T>
+T min_value(const TDynamicMatrix<T>& m)
+{
+    return reduce_extremum<T, T>(m.size(), m.size(), [&](size_t i) { return m[i].data(); },
+        [](T x) { return x; }, [](T a, T b) { return a < b; }).value;
+}
+
+template<typename T>
+size_t argmax(const TDynamicMatrix<T>& m)
+{
+    return reduce_extremum<T, T>(m.size(), m.size(), [&](size_t i) { return m[i].data(); },
+        [](T x) { return x; }, [](T a, T b) { return a > b; }).pos;
+}
+
+template<typename T>
+T max_value(const TDynamicMatrix<T>& m)
+{
+    size_t p = argmax(m);
+    return m[p / m.size()][p % m.size()];
+}
+
+template<typename T>
+T trace(const TDynamicMatrix<T>& m, TReduceMode mode = TReduceMode::fast)
+{
+    size_t n = m.size();
+    TDynamicVector<T> d(n);
+    for (size_t i = 0; i < n; i++) {
+        d[i] = m[i][i];
+    }
+    return sum(d, mode);
+}
+
+// Политики накопления сумм для dot и gemm_acc
+// TNaiveSum - обычное накопление в T; TWideSum - в более широком типе
+// (float -> double, целые -> 64 бита); TPairwiseSum - попарное сложение
+// сумм коротких блоков; TKahanSum - компенсированное суммирование Кэхэна.
+// Компенсация ведется отдельно в каждой полосе (lane) или элементе строки
+// результата, поэтому циклы остаются векторизуемыми. Не собирать с
+// -ffast-math: компилятор вправе удалить компенсацию.
+template<typename T>
+using TWide = typename conditional<is_integral<T>::value && (sizeof(T) < 8),
+    typename conditional<is_signed<T>::value, int64_t, uint64_t>::type,
+    typename conditional<is_same<T, float>::value, double, T>::type>::type;
+
+struct TNaiveSum
+{
+    template<typename T> using acc_t = T;
+    static const bool kahan = false, pairwise = false;
+};
+struct TWideSum
+{
+    template<typename T> using acc_t = TWide<T>;
+    static const bool kahan = false, pairwise = false;
+};
+struct TPairwiseSum
+{
+    template<typename T> using acc_t = T;
+    static const bool kahan = false, pairwise = true;
+};
+struct TKahanSum
+{
+    template<typename T> using acc_t = T;
+    static const bool kahan = true, pairwise = false;
+};
 
+const size_t PAIRWISE_BLOCK = 128;
+
+template<typename R>
+void kahan_add(R& s, R& c, R x) noexcept
+{
+    R y = x - c;
+    R t = s + y;
+    c = (t - s) - y;
+    s = t;
+}
+
+// скалярное произведение блока в REDUCE_LANES полосах
+template<typename P, typename R, typename T>
+R dot_block(const T* a, const T* b, size_t n) noexcept
+{
+    R s[REDUCE_LANES] = {}, c[REDUCE_LANES] = {};
+    size_t i = 0;
+    for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) {
+        for (size_t l = 0; l < REDUCE_LANES; l++) {
+            R x = R(a[i + l]) * R(b[i + l]);
+            if (P::kahan)
+                kahan_add(s[l], c[l], x);
+            else
+                s[l] += x;
+        }
+    }
+    for (; i < n; i++) {
+        R x = R(a[i]) * R(b[i]);
+        if (P::kahan)
+            kahan_add(s[i % REDUCE_LANES], c[i % REDUCE_LANES], x);
+        else
+            s[i % REDUCE_LANES] += x;
+    }
+    R res = R(0), comp = R(0);
+    for (size_t l = 0; l < REDUCE_LANES; l++) {
+        if (P::kahan) {
+            kahan_add(res, comp, s[l]);
+            kahan_add(res, comp, -c[l]);
+        }
+        else
+            res += s[l];
+    }
+    return res;
+}
+
+// Скалярное произведение с политикой накопления P. Блоки обрабатываются
+// параллельно и объединяются в фиксированном порядке.
+template<typename P, typename T>
+typename P::template acc_t<T> dot(const TDynamicVector<T>& a, const TDynamicVector<T>& b)
+{
+    typedef typename P::template acc_t<T> R;
+    if (a.size() != b.size()) {
+        throw length_error("different vector sizes");
+    }
+    size_t n = a.size(), bs = P::pairwise ? PAIRWISE_BLOCK : REDUCE_BLOCK;
+    size_t blocks = (n + bs - 1) / bs;
+    std::vector<R> part(blocks);
+    parallel_for(0, blocks, [&](size_t lo, size_t hi) {
+        for (size_t q = lo; q < hi; q++) {
+            size_t i0 = q * bs;
+            part[q] = dot_block<P, R>(a.data() + i0, b.data() + i0, min(bs, n - i0));
+        }
+    }, bs);
+    if (P::pairwise) {
+        return tree_sum(part);
+    }
+    R res = R(0), comp = R(0);
+    for (const R& x : part) {
+        if (P::kahan)
+            kahan_add(res, comp, x);
+        else
+            res += x;
+    }
+    return res;
+}
+
+// Умножение матриц с политикой накопления P: строки распределяются по
+// потокам, строка C накапливается по k целиком. Для TPairwiseSum суммы
+// блоков по PAIRWISE_BLOCK значений k складываются попарно через стек
+// уровней (двоичный счетчик), для TKahanSum каждый элемент строки имеет
+// свою поправку.
+template<typename P, typename T>
+TDynamicMatrix<typename P::template acc_t<T>> gemm_acc(const TDynamicMatrix<T>& A, const TDynamicMatrix<T>& B)
+{
+    typedef typename P::template acc_t<T> R;
+    size_t n = A.size();
+    if (B.size() != n) {
+        throw length_error("different matrix sizes");
+    }
+    TDynamicMatrix<R> C(n);
+    parallel_for(0, n, [&](size_t lo, size_t hi) {
+        std::vector<R> part(n), comp(n);
+        std::vector<std::vector<R>> levels;
+        std::vector<bool> used;
+        for (size_t i = lo; i < hi; i++) {
+            R* c = C[i].data();
+            const T* a = A[i].data();
+            if (!P::pairwise) {
+                std::fill(comp.begin(), comp.end(), R(0));
+                for (size_t k = 0; k < n; k++) {
+                    const R aik = R(a[k]);
+                    const T* b = B[k].data();
+                    if (P::kahan) {
+                        for (size_t j = 0; j < n; j++)
+                            kahan_add(c[j], comp[j], aik * R(b[j]));
+                    }
+                    else {
+                        for (size_t j = 0; j < n; j++)
+                            c[j] += aik * R(b[j]);
+                    }
+                }
+                continue;
+            }
+            for (size_t k0 = 0; k0 < n; k0 += PAIRWISE_BLOCK) {
+                std::fill(part.begin(), part.end(), R(0));
+                for (size_t k = k0; k < min(n, k0 + PAIRWISE_BLOCK); k++) {
+                    const R aik = R(a[k]);
+                    const T* b = B[k].data();
+                    for (size_t j = 0; j < n; j++)
+                        part[j] += aik * R(b[j]);
+                }
+                size_t lv = 0;
+                for (; lv < used.size() && used[lv]; lv++) {
+                    for (size_t j = 0; j < n; j++)
+                        part[j] += levels[lv][j];
+                    used[lv] = false;
+                }
+                if (lv == used.size()) {
+                    levels.emplace_back(n);
+                    used.push_back(false);
+                }
+                levels[lv].swap(part);
+                part.resize(n);
+                used[lv] = true;
+            }
+            for (size_t lv = 0; lv < used.size(); lv++) {
+                if (used[lv]) {
+                    for (size_t j = 0; j < n; j++)
+                        c[j] += levels[lv][j];
+                    used[lv] = false;
+                }
+            }
+        }
+    }, n * n);
+    return C;
+}
+
+// Поэлементные математические функции
+// Скалярные ядра без ветвлений (особые значения выбираются в конце),
+// поэтому циклы над строками векторизуются компилятором. Вычисления
+// ведутся в double, float приводится к double и обратно. Погрешность
+// относительно правильно округленного результата (измерена на
+// равномерных выборках из рабочих диапазонов):
+//   fast_exp  - не более 1 ULP
+//   fast_log  - не более 2 ULP
+//   fast_tanh - не более 2 ULP
+//   sqrt      - аппаратный корень, правильное округление (0 ULP)
+//   fast_pow  - exp(y * log(x)), погрешность растет как |y * ln x| ULP;
+//               определена для x >= 0
+inline double bits_to_double(uint64_t b) noexcept
+{
+    double d;
+    memcpy(&d, &b, sizeof(d));
+    return d;
+}
+inline uint64_t double_to_bits(double d) noexcept
+{
+    uint64_t b;
+    memcpy(&b, &d, sizeof(b));
+    return b;
+}
+
+// Векторизация требует флага компилятора: при -ftrapping-math (по
+// умолчанию) GCC и Clang не переводят выбор по сравнению вещественных
+// чисел в векторную форму. Код, включающий tmatrix.h вне этой сборки,
+// должен компилироваться с -fno-trapping-math; без флага результаты те же,
+// но циклы выполняются поэлементно.
+inline double fast_exp(double x) noexcept
+{
+    const double log2e = 1.4426950408889634;
+    const double ln2_hi = 6.93147180369123816490e-01, ln2_lo = 1.90821492927058770002e-10;
+    double xc = (x != x) ? 0.0 : (x < -746.0 ? -746.0 : (x > 710.0 ? 710.0 : x));
+    // округление до целого сдвигом на 1.5 * 2^52, k - в младших битах
+    const double shifter = 6755399441055744.0;
+    double t = xc * log2e + shifter;
+    double kd = t - shifter;
+    double r = (xc - kd * ln2_hi) - kd * ln2_lo;
+    // ряд Тейлора до r^13/13!, |r| <= ln2 / 2
+    double p = 1.0 / 6227020800.0;
+    p = p * r + 1.0 / 479001600.0;
+    p = p * r + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+    // 2^k двумя множителями, чтобы не выйти за диапазон показателя
+    int64_t k = (int64_t)(double_to_bits(t) - double_to_bits(shifter)), k1 = k >> 1, k2 = k - k1;
+    double res = p * bits_to_double((uint64_t)(k1 + 1023) << 52) * bits_to_double((uint64_t)(k2 + 1023) << 52);
+    return (x != x) ? x : res;
+}
+
+inline double fast_log(double x) noexcept
+{
+    const double ln2_hi = 6.93147180369123816490e-01, ln2_lo = 1.90821492927058770002e-10;
+    const double sqrt2 = 1.4142135623730951;
+    bool sub = x < 2.2250738585072014e-308;
+    double xs = sub ? x * 4503599627370496.0 : x; // 2^52
+    uint64_t b = double_to_bits(xs);
+    // показатель как double: биты показателя в мантиссе числа 2^52
+    double e = bits_to_double(((b >> 52) & 0x7ff) | 0x4330000000000000ULL) - 4503599627370496.0;
+    e = e - (sub ? 1075.0 : 1023.0);
+    double m = bits_to_double((b & 0xfffffffffffffULL) | (uint64_t(1023) << 52));
+    bool big = m > sqrt2;
+    m = big ? m * 0.5 : m;
+    e = big ? e + 1.0 : e;
+    // log m = 2 atanh(f), |f| <= 0.1716
+    double f = (m - 1.0) / (m + 1.0), z = f * f;
+    double s = 1.0 / 21;
+    s = s * z + 1.0 / 19;
+    s = s * z + 1.0 / 17;
+    s = s * z + 1.0 / 15;
+    s = s * z + 1.0 / 13;
+    s = s * z + 1.0 / 11;
+    s = s * z + 1.0 / 9;
+    s = s * z + 1.0 / 7;
+    s = s * z + 1.0 / 5;
+    s = s * z + 1.0 / 3;
+    double res = e * ln2_hi + (2.0 * f + (2.0 * f * z * s + e * ln2_lo));
+    const double inf = numeric_limits<double>::infinity();
+    res = (x == 0) ? -inf : res;
+    res = (x == inf) ? inf : res;
+    return (x < 0 || x != x) ? numeric_limits<double>::quiet_NaN() : res;
+}
+
+inline double fast_tanh(double x) noexcept
+{
+    double a = std::fabs(x);
+    // |x| < 0.625: рациональное приближение (Cephes)
+    double z = x * x;
+    double p = (-9.64399179425052238628e-1 * z - 9.92877231001918586564e1) * z - 1.61468768441708447952e3;
+    double q = ((z + 1.12811678491632931402e2) * z + 2.23548839060100448583e3) * z + 4.84406305325125486048e3;
+    double small = x + x * z * p / q;
+    // иначе 1 - 2 / (e^(2|x|) + 1), при переполнении экспоненты - точно 1
+    double t = 1.0 - 2.0 / (fast_exp(2.0 * a) + 1.0);
+    double large = std::copysign(t, x);
+    return a < 0.625 ? small : large;
+}
+
+inline double fast_pow(double x, double y) noexcept
+{
+    double res = fast_exp(y * fast_log(x));
+    res = (y == 0) ? 1.0 : res;
+    return (x == 0 && y > 0) ? 0.0 : res;
+}
+
+// f применяется к каждому элементу на месте, большие массивы - параллельно
+const size_t MATH_COST = 32;
+
+template<typename T, typename F>
+void math_inplace(T* p, size_t n, F f)
+{
+    static_assert(is_floating_point<T>::value, "element-wise math requires a floating point type");
+    parallel_for(0, n, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            p[i] = T(f(double(p[i])));
+        }
+    }, MATH_COST);
+}
+
+template<typename T, typename F>
+void math_inplace(TDynamicMatrix<T>& m, F f)
+{
+    static_assert(is_floating_point<T>::value, "element-wise math requires a floating point type");
+    size_t n = m.size();
+    parallel_for(0, n, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            T* r = m[i].data();
+            for (size_t j = 0; j < n; j++) {
+                r[j] = T(f(double(r[j])));
+            }
+        }
+    }, n * MATH_COST);
+}
+
+template<typename T> void vexp_inplace(TDynamicVector<T>& v) { math_inplace(v.data(), v.size(), [](double x) { return fast_exp(x); }); }
+template<typename T> void vlog_inplace(TDynamicVector<T>& v) { math_inplace(v.data(), v.size(), [](double x) { return fast_log(x); }); }
+template<typename T> void vtanh_inplace(TDynamicVector<T>& v) { math_inplace(v.data(), v.size(), [](double x) { return fast_tanh(x); }); }
+template<typename T> void vsqrt_inplace(TDynamicVector<T>& v)
+{
+    math_inplace(v.data(), v.size(), [](double x) { return std::sqrt(x); });
+}
+template<typename T> void vpow_inplace(TDynamicVector<T>& v, double y)
+{
+    math_inplace(v.data(), v.size(), [y](double x) { return fast_pow(x, y); });
+}
+
+template<typename T> void vexp_inplace(TDynamicMatrix<T>& m) { math_inplace(m, [](double x) { return fast_exp(x); }); }
+template<typename T> void vlog_inplace(TDynamicMatrix<T>& m) { math_inplace(m, [](double x) { return fast_log(x); }); }
+template<typename T> void vtanh_inplace(TDynamicMatrix<T>& m) { math_inplace(m, [](double x) { return fast_tanh(x); }); }
+template<typename T> void vsqrt_inplace(TDynamicMatrix<T>& m)
+{
+    math_inplace(m, [](double x) { return std::sqrt(x); });
+}
+template<typename T> void vpow_inplace(TDynamicMatrix<T>& m, double y)
+{
+    math_inplace(m, [y](double x) { return fast_pow(x, y); });
+}
+
+// варианты с результатом в новом объекте (C - вектор или матрица)
+template<typename C> C vexp(C a) { vexp_inplace(a); return a; }
+template<typename C> C vlog(C a) { vlog_inplace(a); return a; }
+template<typename C> C vtanh(C a) { vtanh_inplace(a); return a; }
+template<typename C> C vsqrt(C a) { vsqrt_inplace(a); return a; }
+template<typename C> C vpow(C a, double y) { vpow_inplace(a, y); return a; }
+
+// Поэлементные матричные операции и операции с трансляцией вектора
+// Один проход по памяти строк без промежуточных матриц; по умолчанию
+// строки делятся между потоками.
+template<typename T>
+TDynamicMatrix<T> hadamard(const TDynamicMatrix<T>& a, const TDynamicMatrix<T>& b, TExecution ex = TExecution::par)
+{
+    return a.zip(b, [](T x, T y) { return T(x * y); }, ex);
+}
+
+template<typename T>
+TDynamicMatrix<T>& hadamard_inplace(TDynamicMatrix<T>& a, const TDynamicMatrix<T>& b, TExecution ex = TExecution::par)
+{
+    if (a.size() != b.size()) {
+        throw length_error("different matrix sizes");
+    }
+    size_t n = a.size();
+    elementwise_rows(n, n, ex, [&](size_t i, TExecution inner) {
+        T* x = a[i].data();
+        const T* y = b[i].data();
+        elementwise(n, inner, [&](size_t j) { x[j] *= y[j]; });
+    });
+    return a;
+}
+
+// для целых типов деление на ноль проверяется заранее
+template<typename T>
+void check_divisor(const TDynamicMatrix<T>& b)
+{
+    if (!is_integral<T>::value) {
+        return;
+    }
+    size_t n = b.size();
+    for (size_t i = 0; i < n; i++) {
+        if (std::find(b[i].data(), b[i].data() + n, T(0)) != b[i].data() + n) {
+            throw domain_error("integer division by zero");
+        }
+    }
+}
+
+template<typename T>
+TDynamicMatrix<T> divide(const TDynamicMatrix<T>& a, const TDynamicMatrix<T>& b, TExecution ex = TExecution::par)
+{
+    if (a.size() != b.size()) {
+        throw length_error("different matrix sizes");
+    }
+    check_divisor(b);
+    return a.zip(b, [](T x, T y) { return T(x / y); }, ex);
+}
+
+template<typename T>
+TDynamicMatrix<T>& divide_inplace(TDynamicMatrix<T>& a, const TDynamicMatrix<T>& b, TExecution ex = TExecution::par)
+{
+    if (a.size() != b.size()) {
+        throw length_error("different matrix sizes");
+    }
+    check_divisor(b);
+    size_t n = a.size();
+    elementwise_rows(n, n, ex, [&](size_t i, TExecution inner) {
+        T* x = a[i].data();
+        const T* y = b[i].data();
+        elementwise(n, inner, [&](size_t j) { x[j] /= y[j]; });
+    });
+    return a;
+}
+
+// a[i][j] = f(a[i][j], v[j]) - вектор применяется к каждой строке
+template<typename T, typename F>
+TDynamicMatrix<T>& broadcast_rows_inplace(TDynamicMatrix<T>& a, const TDynamicVector<T>& v, F f, TExecution ex = TExecution::par)
+{
+    if (a.size() != v.size()) {
+        throw length_error("bad vector size");
+    }
+    size_t n = a.size();
+    const T* y = v.data();
+    elementwise_rows(n, n, ex, [&](size_t i, TExecution inner) {
+        T* x = a[i].data();
+        elementwise(n, inner, [&](size_t j) { x[j] = f(x[j], y[j]); });
+    });
+    return a;
+}
+
+// a[i][j] = f(a[i][j], v[i]) - вектор применяется к каждому столбцу
+template<typename T, typename F>
+TDynamicMatrix<T>& broadcast_cols_inplace(TDynamicMatrix<T>& a, const TDynamicVector<T>& v, F f, TExecution ex = TExecution::par)
+{
+    if (a.size() != v.size()) {
+        throw length_error("bad vector size");
+    }
+    size_t n = a.size();
+    elementwise_rows(n, n, ex, [&](size_t i, TExecution inner) {
+        T* x = a[i].data();
+        const T yi = v[i];
+        elementwise(n, inner, [&](size_t j) { x[j] = f(x[j], yi); });
+    });
+    return a;
+}
+
+template<typename T, typename F>
+TDynamicMatrix<T> broadcast_rows(const TDynamicMatrix<T>& a, const TDynamicVector<T>& v, F f, TExecution ex = TExecution::par)
+{
+    if (a.size() != v.size()) {
+        throw length_error("bad vector size");
+    }
+    size_t n = a.size();
+    TDynamicMatrix<T> res(n);
+    const T* y = v.data();
+    elementwise_rows(n, n, ex, [&](size_t i, TExecution inner) {
+        T* r = res[i].data();
+        const T* x = a[i].data();
+        elementwise(n, inner, [&](size_t j) { r[j] = f(x[j], y[j]); });
+    });
+    return res;
+}
+
+template<typename T, typename F>
+TDynamicMatrix<T> broadcast_cols(const TDynamicMatrix<T>& a, const TDynamicVector<T>& v, F f, TExecution ex = TExecution::par)
+{
+    if (a.size() != v.size()) {
+        throw length_error("bad vector size");
+    }
+    size_t n = a.size();
+    TDynamicMatrix<T> res(n);
+    elementwise_rows(n, n, ex, [&](size_t i, TExecution inner) {
+        T* r = res[i].data();
+        const T* x = a[i].data();
+        const T yi = v[i];
+        elementwise(n, inner, [&](size_t j) { r[j] = f(x[j], yi); });
+    });
+    return res;
+}
+
+template<typename T>
+TDynamicMatrix<T> add_to_rows(const TDynamicMatrix<T>& a, const TDynamicVector<T>& v)
+{
+    return broadcast_rows(a, v, [](T x, T y) { return T(x + y); });
+}
+
+template<typename T>
+TDynamicMatrix<T> add_to_cols(const TDynamicMatrix<T>& a, const TDynamicVector<T>& v)
+{
+    return broadcast_cols(a, v, [](T x, T y) { return T(x + y); });
+}
+
+template<typename T>
+TDynamicMatrix<T>& add_to_rows_inplace(TDynamicMatrix<T>& a, const TDynamicVector<T>& v)
+{
+    return broadcast_rows_inplace(a, v, [](T x, T y) { return T(x + y); });
+}
+
+template<typename T>
+TDynamicMatrix<T>& add_to_cols_inplace(TDynamicMatrix<T>& a, const TDynamicVector<T>& v)
+{
+    return broadcast_cols_inplace(a, v, [](T x, T y) { return T(x + y); });
+}
+
+// Полукольца для GEMM: zero() - нейтральный элемент сложения (и поглощающий
+// для умножения), one() - нейтральный элемент умножения
+template<typename T>
+struct TPlusTimes
+{
+    static T zero() noexcept { return T(0); }
+    static T one() noexcept { return T(1); }
+    static T add(T a, T b) noexcept { return a + b; }
+    static T mul(T a, T b) noexcept { return a * b; }
+};
+
+// кратчайшие пути: бесконечность - отсутствие ребра
+template<typename T>
+struct TMinPlus
+{
+    static T zero() noexcept
+    {
+        return numeric_limits<T>::has_infinity ? numeric_limits<T>::infinity() : numeric_limits<T>::max();
+    }
+    static T one() noexcept { return T(0); }
+    static T add(T a, T b) noexcept { return b < a ? b : a; }
+    static T mul(T a, T b) noexcept { return (a == zero() || b == zero()) ? zero() : a + b; }
+};
+
+// самые длинные (критические) пути
+template<typename T>
+struct TMaxPlus
+{
+    static T zero() noexcept
+    {
+        return numeric_limits<T>::has_infinity ? -numeric_limits<T>::infinity() : numeric_limits<T>::lowest();
+    }
+    static T one() noexcept { return T(0); }
+    static T add(T a, T b) noexcept { return a < b ? b : a; }
+    static T mul(T a, T b) noexcept { return (a == zero() || b == zero()) ? zero() : a + b; }
+};
+
+// пути с наибольшей пропускной способностью
+template<typename T>
+struct TMaxMin
+{
+    static T zero() noexcept { return TMaxPlus<T>::zero(); }
+    static T one() noexcept { return TMinPlus<T>::zero(); }
+    static T add(T a, T b) noexcept { return a < b ? b : a; }
+    static T mul(T a, T b) noexcept { return b < a ? b : a; }
+};
+
+// достижимость
+template<typename T>
+struct TOrAnd
+{
+    static T zero() noexcept { return T(0); }
+    static T one() noexcept { return T(1); }
+    static T add(T a, T b) noexcept { return (a != T(0) || b != T(0)) ? T(1) : T(0); }
+    static T mul(T a, T b) noexcept { return (a != T(0) && b != T(0)) ? T(1) : T(0); }
+};
+
+// Блочное умножение (ядро GEMM) над полукольцом S
+// C[i][j] = add(C[i][j], mul(mul(alpha, A[i][k]), B[k][j])) для i из [i0, i1),
+// j из [j0, j1), k из [k0, k1). Строки C распределяются по потокам,
+// внутренний цикл идет по непрерывной строке B и векторизуется компилятором.
+// C может совпадать с B, если строки [i0, i1) не пересекаются с [k0, k1).
+const size_t GEMM_BLOCK_K = 256;
+const size_t GEMM_BLOCK_J = 2048;
+
+template<typename S, typename T>
+void semiring_update(TDynamicMatrix<T>& C, const TDynamicMatrix<T>& A, const TDynamicMatrix<T>& B,
+    size_t i0, size_t i1, size_t j0, size_t j1, size_t k0, size_t k1, T alpha = S::one())
+{
+    if (i0 >= i1 || j0 >= j1 || k0 >= k1) {
+        return;
+    }
+    parallel_for(i0, i1, [&](size_t lo, size_t hi) {
+        for (size_t kb = k0; kb < k1; kb += GEMM_BLOCK_K) {
+            size_t ke = min(k1, kb + GEMM_BLOCK_K);
+            for (size_t jb = j0; jb < j1; jb += GEMM_BLOCK_J) {
+                size_t je = min(j1, jb + GEMM_BLOCK_J);
+                for (size_t i = lo; i < hi; i++) {
+                    T* c = C[i].data();
+                    const T* a = A[i].data();
+                    for (size_t k = kb; k < ke; k++) {
+                        const T aik = S::mul(alpha, a[k]);
+                        const T* b = B[k].data();
+                        for (size_t j = jb; j < je; j++) {
+                            c[j] = S::add(c[j], S::mul(aik, b[j]));
+                        }
+                    }
+                }
+            }
+        }
+    }, (k1 - k0) * (j1 - j0));
+}
+
+template<typename T>
+void gemm_update(TDynamicMatrix<T>& C, const TDynamicMatrix<T>& A, const TDynamicMatrix<T>& B,
+    size_t i0, size_t i1, size_t j0, size_t j1, size_t k0, size_t k1, T alpha = T(1))
+{
+    semiring_update<TPlusTimes<T>>(C, A, B, i0, i1, j0, j1, k0, k1, alpha);
+}
+
+// C = A * B над полукольцом S в уже выделенную матрицу C
+template<template<typename> class S = TPlusTimes, typename T>
+void gemm_into(TDynamicMatrix<T>& C, const TDynamicMatrix<T>& A, const TDynamicMatrix<T>& B)
+{
+    size_t n = A.size();
+    if (B.size() != n || C.size() != n) {
+        throw length_error("different matrix sizes");
+    }
+    if (&C == &A || &C == &B) {
+        throw invalid_argument("result matrix should not alias an operand");
+    }
+    for (size_t i = 0; i < n; i++) {
+        std::fill(C[i].data(), C[i].data() + n, S<T>::zero());
+    }
+    semiring_update<S<T>>(C, A, B, 0, n, 0, n, 0, n);
+}
+
+template<template<typename> class S = TPlusTimes, typename T>
+TDynamicMatrix<T> gemm(const TDynamicMatrix<T>& A, const TDynamicMatrix<T>& B)
+{
+    if (B.size() != A.size()) {
+        throw length_error("different matrix sizes");
+    }
+    TDynamicMatrix<T> C(A.size());
+    gemm_into<S>(C, A, B);
+    return C;
+}
+
+// Замыкание над полукольцом повторным возведением в квадрат:
+// D = A + E, затем D = D * D, пока матрица меняется (не более log2(n) шагов).
+// Для TMinPlus - кратчайшие пути между всеми парами вершин.
+template<template<typename> class S, typename T>
+TDynamicMatrix<T> semiring_closure(const TDynamicMatrix<T>& A)
+{
+    size_t n = A.size();
+    TDynamicMatrix<T> cur(A), next(n);
+    for (size_t i = 0; i < n; i++) {
+        cur[i][i] = S<T>::add(cur[i][i], S<T>::one());
+    }
+    for (size_t len = 1; len < n; len *= 2) {
+        gemm_into<S>(next, cur, cur);
+        bool same = true;
+        for (size_t i = 0; i < n && same; i++) {
+            same = std::equal(next[i].data(), next[i].data() + n, cur[i].data());
+        }
+        swap(cur, next);
+        if (same) {
+            break;
+        }
+    }
+    return cur;
+}
+
+template<typename T>
+TDynamicMatrix<T> shortest_paths(const TDynamicMatrix<T>& A)
+{
+    return semiring_closure<TMinPlus>(A);
+}
+
+// Степень матрицы и многочлен от матрицы
+// Все произведения пишутся через gemm_into в заранее выделенные буферы,
+// которые меняются местами (swap только обменивает указатели).
+template<typename T>
+void set_identity(TDynamicMatrix<T>& m, T diag = T(1))
+{
+    size_t n = m.size();
+    for (size_t i = 0; i < n; i++) {
+        std::fill(m[i].data(), m[i].data() + n, T(0));
+        m[i][i] = diag;
+    }
+}
+
+// m += c * x
+template<typename T>
+void axpy_inplace(TDynamicMatrix<T>& m, T c, const TDynamicMatrix<T>& x)
+{
+    size_t n = m.size();
+    elementwise_rows(n, n, TExecution::par, [&](size_t i, TExecution inner) {
+        T* r = m[i].data();
+        const T* a = x[i].data();
+        elementwise(n, inner, [&](size_t j) { r[j] += c * a[j]; });
+    });
+}
+
+// A^k бинарным возведением: не более 2 log2(k) умножений, три матрицы
+template<typename T>
+TDynamicMatrix<T> pow(const TDynamicMatrix<T>& A, uint64_t k)
+{
+    size_t n = A.size();
+    TDynamicMatrix<T> res(n), base(A), tmp(n);
+    bool first = true;
+    for (; k; k >>= 1) {
+        if (k & 1) {
+            if (first) {
+                res = base;
+                first = false;
+            }
+            else {
+                gemm_into(tmp, res, base);
+                swap(res, tmp);
+            }
+        }
+        if (k > 1) {
+            gemm_into(tmp, base, base);
+            swap(base, tmp);
+        }
+    }
+    if (first) {
+        set_identity(res);
+    }
+    return res;
+}
+
+// Многочлен c[0] E + c[1] A + ... + c[d] A^d по схеме Патерсона-Стокмейера:
+// s = ceil(sqrt(d + 1)), хранятся A^1..A^s (s - 1 умножений), затем схема
+// Горнера по A^s над блоками из s коэффициентов (ceil((d + 1) / s) - 1
+// умножений) в двух сменяющихся буферах. Итого около 2 sqrt(d) умножений.
+template<typename T>
+TDynamicMatrix<T> polyval(const TDynamicMatrix<T>& A, const TDynamicVector<T>& c)
+{
+    size_t n = A.size(), d1 = c.size();
+    size_t s = 1;
+    while (s * s < d1) {
+        s++;
+    }
+    size_t r = (d1 + s - 1) / s;
+    // pw[i] = A^(i + 1)
+    std::vector<TDynamicMatrix<T>> pw;
+    pw.reserve(s);
+    pw.push_back(A);
+    for (size_t i = 1; i < s; i++) {
+        pw.emplace_back(n);
+        gemm_into(pw[i], pw[i - 1], A);
+    }
+    // блок j: sum_{i < s} c[j s + i] A^i, прибавляется к m
+    auto add_block = [&](TDynamicMatrix<T>& m, size_t j) {
+        for (size_t i = 0; i < s && j * s + i < d1; i++) {
+            T ci = c[j * s + i];
+            if (ci == T(0)) {
+                continue;
+            }
+            if (i == 0) {
+                for (size_t q = 0; q < n; q++) {
+                    m[q][q] += ci;
+                }
+            }
+            else {
+                axpy_inplace(m, ci, pw[i - 1]);
+            }
+        }
+    };
+    TDynamicMatrix<T> cur(n), tmp(n);
+    add_block(cur, r - 1);
+    for (size_t j = r - 1; j-- > 0; ) {
+        gemm_into(tmp, cur, pw[s - 1]);
+        add_block(tmp, j);
+        swap(cur, tmp);
+    }
+    return cur;
+}
+
+// Треугольные системы
+// Прямая/обратная подстановка блоками по TRSM_BLOCK строк: диагональный
+// блок решается скалярно, остаток правой части обновляется через GEMM.
+enum class TTriangle { lower, upper };
+enum class TDiag { non_unit, unit };
+
+const size_t TRSM_BLOCK = 64;
+
+// решение A x = b, результат записывается в b
+template<typename T>
+void trsv(const TDynamicMatrix<T>& A, TDynamicVector<T>& b, TTriangle uplo, TDiag diag = TDiag::non_unit)
+{
+    size_t n = A.size();
+    if (b.size() != n) {
+        throw length_error("bad vector size");
+    }
+    T* x = b.data();
+    auto solve_row = [&](size_t i, size_t r0, size_t r1) {
+        const T* a = A[i].data();
+        T s = x[i];
+        for (size_t r = r0; r < r1; r++) {
+            s -= a[r] * x[r];
+        }
+        if (diag == TDiag::non_unit) {
+            if (a[i] == T(0)) {
+                throw domain_error("singular triangular matrix");
+            }
+            s /= a[i];
+        }
+        x[i] = s;
+    };
+    auto update = [&](size_t i0, size_t i1, size_t k0, size_t k1) {
+        parallel_for(i0, i1, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++) {
+                const T* a = A[i].data();
+                T s = T(0);
+                for (size_t k = k0; k < k1; k++) {
+                    s += a[k] * x[k];
+                }
+                x[i] -= s;
+            }
+        }, k1 - k0);
+    };
+    if (uplo == TTriangle::lower) {
+        for (size_t b0 = 0; b0 < n; b0 += TRSM_BLOCK) {
+            size_t b1 = min(n, b0 + TRSM_BLOCK);
+            for (size_t i = b0; i < b1; i++) {
+                solve_row(i, b0, i);
+            }
+            update(b1, n, b0, b1);
+        }
+    }
+    else {
+        for (size_t b1 = n; b1 > 0; ) {
+            size_t b0 = b1 > TRSM_BLOCK ? b1 - TRSM_BLOCK : 0;
+            for (size_t i = b1; i-- > b0; ) {
+                solve_row(i, i + 1, b1);
+            }
+            update(0, b0, b0, b1);
+            b1 = b0;
+        }
+    }
+}
+
+// решение A X = B для всех столбцов B, результат записывается в B
+template<typename T>
+void trsm(const TDynamicMatrix<T>& A, TDynamicMatrix<T>& B, TTriangle uplo, TDiag diag = TDiag::non_unit)
+{
+    size_t n = A.size();
+    if (B.size() != n) {
+        throw length_error("different matrix sizes");
+    }
+    if (diag == TDiag::non_unit) {
+        for (size_t i = 0; i < n; i++) {
+            if (A[i][i] == T(0)) {
+                throw domain_error("singular triangular matrix");
+            }
+        }
+    }
+    // диагональный блок: строки [b0, b1), столбцы B делятся между потоками
+    auto solve_block = [&](size_t b0, size_t b1) {
+        parallel_for(0, n, [&](size_t lo, size_t hi) {
+            auto solve_row = [&](size_t i, size_t r0, size_t r1) {
+                T* x = B[i].data();
+                const T* a = A[i].data();
+                for (size_t r = r0; r < r1; r++) {
+                    const T air = a[r];
+                    const T* y = B[r].data();
+                    for (size_t j = lo; j < hi; j++) {
+                        x[j] -= air * y[j];
+                    }
+                }
+                if (diag == TDiag::non_unit) {
+                    const T d = a[i];
+                    for (size_t j = lo; j < hi; j++) {
+                        x[j] /= d;
+                    }
+                }
+            };
+            if (uplo == TTriangle::lower) {
+                for (size_t i = b0; i < b1; i++) {
+                    solve_row(i, b0, i);
+                }
+            }
+            else {
+                for (size_t i = b1; i-- > b0; ) {
+                    solve_row(i, i + 1, b1);
+                }
+            }
+        }, (b1 - b0) * (b1 - b0));
+    };
+    if (uplo == TTriangle::lower) {
+        for (size_t b0 = 0; b0 < n; b0 += TRSM_BLOCK) {
+            size_t b1 = min(n, b0 + TRSM_BLOCK);
+            solve_block(b0, b1);
+            gemm_update(B, A, B, b1, n, 0, n, b0, b1, T(-1));
+        }
+    }
+    else {
+        for (size_t b1 = n; b1 > 0; ) {
+            size_t b0 = b1 > TRSM_BLOCK ? b1 - TRSM_BLOCK : 0;
+            solve_block(b0, b1);
+            gemm_update(B, A, B, 0, b0, 0, n, b0, b1, T(-1));
+            b1 = b0;
+        }
+    }
+}
+
+// Обновления ранга 1 и ранга k
+// ger: A += alpha * x * y^T. Строки A делятся между потоками, y читается
+// блоками по GEMM_BLOCK_J, которые остаются в кэше для всех строк потока.
+template<typename T>
+void ger(TDynamicMatrix<T>& A, T alpha, const TDynamicVector<T>& x, const TDynamicVector<T>& y)
+{
+    size_t n = A.size();
+    if (x.size() != n || y.size() != n) {
+        throw length_error("bad vector size");
+    }
+    const T* py = y.data();
+    parallel_for(0, n, [&](size_t lo, size_t hi) {
+        for (size_t jb = 0; jb < n; jb += GEMM_BLOCK_J) {
+            size_t je = min(n, jb + GEMM_BLOCK_J);
+            for (size_t i = lo; i < hi; i++) {
+                const T axi = alpha * x[i];
+                T* a = A[i].data();
+                for (size_t j = jb; j < je; j++) {
+                    a[j] += axi * py[j];
+                }
+            }
+        }
+    }, n);
+}
+
+template<typename T>
+TDynamicMatrix<T> outer(const TDynamicVector<T>& x, const TDynamicVector<T>& y)
+{
+    TDynamicMatrix<T> res(x.size());
+    ger(res, T(1), x, y);
+    return res;
+}
+
+// syrk: C = alpha * A * A^T + beta * C (no_trans) или
+//       C = alpha * A^T * A + beta * C (trans, ковариация по строкам-наблюдениям).
+// Вычисляется и изменяется только треугольник uplo, вдвое меньше операций.
+// Строки треугольника разной длины, поэтому поток получает пары строк
+// (i, n - 1 - i) с одинаковой суммарной работой.
+enum class TTranspose { no_trans, trans };
+
+template<typename T>
+void syrk(TDynamicMatrix<T>& C, const TDynamicMatrix<T>& A, T alpha = T(1), T beta = T(1),
+    TTriangle uplo = TTriangle::lower, TTranspose trans = TTranspose::no_trans)
+{
+    size_t n = A.size();
+    if (C.size() != n) {
+        throw length_error("different matrix sizes");
+    }
+    const bool lower = uplo == TTriangle::lower;
+    auto row_range = [&](size_t i, size_t& j0, size_t& j1) {
+        j0 = lower ? 0 : i;
+        j1 = lower ? i + 1 : n;
+    };
+    size_t units = (n + 1) / 2;
+    parallel_for(0, units, [&](size_t lo, size_t hi) {
+        std::vector<T> acc(n);
+        for (size_t u = lo; u < hi; u++) {
+            size_t rows[2] = { u, n - 1 - u };
+            for (size_t r = 0; r < (rows[0] == rows[1] ? 1u : 2u); r++) {
+                size_t i = rows[r], j0, j1;
+                row_range(i, j0, j1);
+                T* c = C[i].data();
+                std::fill(acc.begin() + j0, acc.begin() + j1, T(0));
+                if (trans == TTranspose::no_trans) {
+                    // acc[j] = <A_i, A_j> по блокам k, скалярные произведения в полосах
+                    const T* ai = A[i].data();
+                    for (size_t kb = 0; kb < n; kb += GEMM_BLOCK_K) {
+                        size_t ke = min(n, kb + GEMM_BLOCK_K);
+                        for (size_t j = j0; j < j1; j++) {
+                            const T* aj = A[j].data();
+                            T s[REDUCE_LANES] = {};
+                            size_t k = kb;
+                            for (; k + REDUCE_LANES <= ke; k += REDUCE_LANES)
+                                for (size_t l = 0; l < REDUCE_LANES; l++)
+                                    s[l] += ai[k + l] * aj[k + l];
+                            for (; k < ke; k++)
+                                s[0] += ai[k] * aj[k];
+                            for (size_t l = 1; l < REDUCE_LANES; l++)
+                                s[0] += s[l];
+                            acc[j] += s[0];
+                        }
+                    }
+                }
+                else {
+                    // acc[j] += A[k][i] * A[k][j] - обновления ранга 1 отрезка строки
+                    for (size_t k = 0; k < n; k++) {
+                        const T* ak = A[k].data();
+                        const T aki = ak[i];
+                        for (size_t j = j0; j < j1; j++)
+                            acc[j] += aki * ak[j];
+                    }
+                }
+                // beta = 0: C перезаписывается, NaN и Inf в ней не учитываются (как в BLAS)
+                if (beta == T(0)) {
+                    for (size_t j = j0; j < j1; j++)
+                        c[j] = alpha * acc[j];
+                }
+                else {
+                    for (size_t j = j0; j < j1; j++)
+                        c[j] = alpha * acc[j] + beta * c[j];
+                }
+            }
+        }
+    }, n * n * n / 2);
+}
+
+// Произведение Кронекера
+// Явное: строка (i * m + p) результата состоит из блоков A[i][j] * B[p],
+// строки результата заполняются параллельно.
+template<typename T>
+TDynamicMatrix<T> kron(const TDynamicMatrix<T>& A, const TDynamicMatrix<T>& B)
+{
+    size_t n = A.size(), m = B.size();
+    if (n * m > MAX_MATRIX_SIZE) {
+        throw length_error("bad matrix size");
+    }
+    TDynamicMatrix<T> res(n * m);
+    parallel_for(0, n * m, [&](size_t lo, size_t hi) {
+        for (size_t r = lo; r < hi; r++) {
+            const T* a = A[r / m].data();
+            const T* b = B[r % m].data();
+            T* c = res[r].data();
+            for (size_t j = 0; j < n; j++) {
+                const T aij = a[j];
+                T* cj = c + j * m;
+                for (size_t q = 0; q < m; q++) {
+                    cj[q] = aij * b[q];
+                }
+            }
+        }
+    }, n * m);
+    return res;
+}
+
+// Неявный оператор A (x) B порядка n * m: матрица не строится, умножение
+// на вектор использует (A (x) B) vec(X) = vec(B X A^T), где X - m x n,
+// vec - по столбцам. Столбцы X - последовательные блоки v длины m, и
+// произведение стоит O(n m (n + m)) операций вместо O(n^2 m^2).
+template<typename T>
+class TKroneckerOperator
+{
+    TDynamicMatrix<T> a, b;
+public:
+    TKroneckerOperator(const TDynamicMatrix<T>& A, const TDynamicMatrix<T>& B) : a(A), b(B)
+    {
+        if (a.size() * b.size() > MAX_VECTOR_SIZE) {
+            throw length_error("bad operator size");
+        }
+    }
+
+    size_t size() const noexcept { return a.size() * b.size(); }
+    const TDynamicMatrix<T>& left() const noexcept { return a; }
+    const TDynamicMatrix<T>& right() const noexcept { return b; }
+
+    // явная матрица, если она помещается в TDynamicMatrix
+    TDynamicMatrix<T> to_matrix() const { return kron(a, b); }
+
+    TDynamicVector<T> operator*(const TDynamicVector<T>& v) const
+    {
+        size_t n = a.size(), m = b.size();
+        if (v.size() != n * m) {
+            throw length_error("bad vector size");
+        }
+        // Z[j] = B * (блок j вектора v), т.е. столбцы B X
+        std::vector<T> z(n * m);
+        const T* pv = v.data();
+        parallel_for(0, n, [&](size_t lo, size_t hi) {
+            for (size_t j = lo; j < hi; j++) {
+                const T* x = pv + j * m;
+                for (size_t p = 0; p < m; p++) {
+                    const T* bp = b[p].data();
+                    T s = T(0);
+                    for (size_t q = 0; q < m; q++) {
+                        s += bp[q] * x[q];
+                    }
+                    z[j * m + p] = s;
+                }
+            }
+        }, m * m);
+        // блок i результата = sum_j A[i][j] * Z[j]
+        TDynamicVector<T> res(n * m);
+        T* py = res.data();
+        parallel_for(0, n, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++) {
+                const T* ai = a[i].data();
+                T* y = py + i * m;
+                for (size_t j = 0; j < n; j++) {
+                    const T aij = ai[j];
+                    const T* zj = z.data() + j * m;
+                    for (size_t p = 0; p < m; p++) {
+                        y[p] += aij * zj[p];
+                    }
+                }
+            }
+        }, n * m);
+        return res;
+    }
+};
+
+// Точная арифметика
+// Сложение и умножение int64_t с контролем переполнения
+inline bool checked_add(int64_t a, int64_t b, int64_t& r) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return !__builtin_add_overflow(a, b, &r);
+#else
+    if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b))
+        return false;
+    r = a + b;
+    return true;
+#endif
+}
+inline bool checked_mul(int64_t a, int64_t b, int64_t& r) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return !__builtin_mul_overflow(a, b, &r);
+#else
+    if (a == 0 || b == 0) {
+        r = 0;
+        return true;
+    }
+    if (a > 0 ? (b > 0 ? a > INT64_MAX / b : b < INT64_MIN / a)
+              : (b > 0 ? a < INT64_MIN / b : a < INT64_MAX / b))
+        return false;
+    r = a * b;
+    return true;
+#endif
+}
+
+// (a * d - b * c) / p, деление нацело. С __int128 промежуточное значение
+// точно, иначе переполнением считается уже переполнение произведений.
+inline int64_t bareiss_step(int64_t a, int64_t d, int64_t b, int64_t c, int64_t p)
+{
+#ifdef __SIZEOF_INT128__
+    __int128 r = ((__int128)a * d - (__int128)b * c) / p;
+    if (r > INT64_MAX || r < INT64_MIN)
+        throw overflow_error("integer overflow in Bareiss elimination");
+    return (int64_t)r;
+#else
+    int64_t ad, bc, r;
+    if (!checked_mul(a, d, ad) || !checked_mul(b, c, bc) || !checked_add(ad, -bc, r))
+        throw overflow_error("integer overflow in Bareiss elimination");
+    return r / p;
+#endif
+}
+
+// Исключение Барейса (fraction-free) над копией матрицы: все промежуточные
+// элементы - миноры исходной матрицы, деление на предыдущий ведущий элемент
+// выполняется нацело. Строки ниже ведущей обновляются параллельно.
+struct TBareissResult
+{
+    size_t rank;
+    int64_t det;
+};
+
+template<typename T>
+TBareissResult bareiss_eliminate(const TDynamicMatrix<T>& A)
+{
+    static_assert(is_integral<T>::value, "Bareiss elimination requires an integral type");
+    size_t n = A.size();
+    std::vector<int64_t> M(n * n);
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < n; j++)
+            M[i * n + j] = static_cast<int64_t>(A[i][j]);
+
+    size_t r = 0;
+    int64_t sign = 1, prev = 1;
+    for (size_t c = 0; c < n && r < n; c++) {
+        size_t p = r;
+        while (p < n && M[p * n + c] == 0)
+            p++;
+        if (p == n)
+            continue;
+        if (p != r) {
+            std::swap_ranges(M.begin() + p * n, M.begin() + (p + 1) * n, M.begin() + r * n);
+            sign = -sign;
+        }
+        const int64_t* pr = M.data() + r * n;
+        const int64_t piv = pr[c];
+        parallel_for(r + 1, n, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++) {
+                int64_t* row = M.data() + i * n;
+                const int64_t f = row[c];
+                for (size_t j = c + 1; j < n; j++)
+                    row[j] = bareiss_step(row[j], piv, f, pr[j], prev);
+                row[c] = 0;
+            }
+        }, n - c);
+        prev = piv;
+        r++;
+    }
+    TBareissResult res;
+    res.rank = r;
+    res.det = (r == n) ? sign * prev : 0;
+    return res;
+}
+
+template<typename T>
+int64_t det_bareiss(const TDynamicMatrix<T>& A)
+{
+    return bareiss_eliminate(A).det;
+}
+
+template<typename T>
+size_t rank_bareiss(const TDynamicMatrix<T>& A)
+{
+    return bareiss_eliminate(A).rank;
+}
+
+// Модульная арифметика для простых p < 2^31: произведения вычетов
+// помещаются в uint64_t
+inline uint64_t mod_pow(uint64_t a, uint64_t e, uint64_t p) noexcept
+{
+    uint64_t r = 1 % p;
+    a %= p;
+    for (; e; e >>= 1) {
+        if (e & 1)
+            r = r * a % p;
+        a = a * a % p;
+    }
+    return r;
+}
+inline uint64_t mod_inv(uint64_t a, uint64_t p) noexcept
+{
+    return mod_pow(a, p - 2, p);
+}
+// детерминированный тест Миллера - Рабина: основания 2, 3, 5, 7 точны
+// для n < 3215031751
+inline bool is_prime_small(uint64_t n) noexcept
+{
+    if (n < 2)
+        return false;
+    for (uint64_t q : { 2, 3, 5, 7 }) {
+        if (n % q == 0)
+            return n == q;
+    }
+    uint64_t d = n - 1;
+    int s = 0;
+    for (; d % 2 == 0; s++)
+        d /= 2;
+    for (uint64_t a : { 2, 3, 5, 7 }) {
+        uint64_t x = mod_pow(a, d, n);
+        if (x == 1 || x == n - 1)
+            continue;
+        int r = 1;
+        for (; r < s; r++) {
+            x = x * x % n;
+            if (x == n - 1)
+                break;
+        }
+        if (r == s)
+            return false;
+    }
+    return true;
+}
+inline uint64_t to_residue(int64_t a, uint64_t p) noexcept
+{
+    int64_t r = a % (int64_t)p;
+    return (uint64_t)(r < 0 ? r + (int64_t)p : r);
+}
+
+// Арифметика по модулю простого p < 2^31 (редукция Барретта)
+inline uint64_t mulhi64(uint64_t a, uint64_t b) noexcept
+{
+#ifdef __SIZEOF_INT128__
+    return (uint64_t)(((unsigned __int128)a * b) >> 64);
+#else
+    uint64_t al = (uint32_t)a, ah = a >> 32, bl = (uint32_t)b, bh = b >> 32;
+    uint64_t p0 = al * bl, p1 = al * bh, p2 = ah * bl, p3 = ah * bh;
+    uint64_t mid = (p0 >> 32) + (uint32_t)p1 + (uint32_t)p2;
+    return p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+#endif
+}
+
+class TModulus
+{
+    uint64_t p;
+    uint64_t barrett; // floor((2^64 - 1) / p)
+    size_t lazy;      // сколько произведений можно накопить без редукции
+public:
+    explicit TModulus(uint64_t mod) : p(mod)
+    {
+        if (p < 2 || p >= (uint64_t(1) << 31))
+            throw invalid_argument("modulus should be in [2, 2^31)");
+        // обратные элементы берутся по малой теореме Ферма
+        if (!is_prime_small(p))
+            throw invalid_argument("modulus should be prime");
+        barrett = UINT64_MAX / p;
+        lazy = (size_t)((UINT64_MAX - p) / ((p - 1) * (p - 1)));
+    }
+
+    uint64_t value() const noexcept { return p; }
+    size_t lazy_terms() const noexcept { return lazy; }
+
+    uint64_t reduce(uint64_t x) const noexcept
+    {
+        uint64_t r = x - mulhi64(x, barrett) * p;
+        r = r >= p ? r - p : r;
+        return r >= p ? r - p : r;
+    }
+    uint64_t residue(int64_t x) const noexcept { return to_residue(x, p); }
+    uint64_t add(uint64_t a, uint64_t b) const noexcept { return a + b >= p ? a + b - p : a + b; }
+    uint64_t sub(uint64_t a, uint64_t b) const noexcept { return a >= b ? a - b : a + p - b; }
+    uint64_t mul(uint64_t a, uint64_t b) const noexcept { return reduce(a * b); }
+    uint64_t pow(uint64_t a, uint64_t e) const noexcept
+    {
+        uint64_t r = 1;
+        for (; e; e >>= 1) {
+            if (e & 1)
+                r = mul(r, a);
+            a = mul(a, a);
+        }
+        return r;
+    }
+    uint64_t inv(uint64_t a) const
+    {
+        if (a % p == 0)
+            throw domain_error("zero has no modular inverse");
+        return pow(a, p - 2);
+    }
+};
+
+template<typename T>
+std::vector<uint64_t> mod_residues(const TDynamicMatrix<T>& A, const TModulus& m)
+{
+    size_t n = A.size();
+    std::vector<uint64_t> M(n * n);
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < n; j++)
+            M[i * n + j] = m.residue(static_cast<int64_t>(A[i][j]));
+    return M;
+}
+
+// Произведение по модулю: строки C накапливают до lazy_terms() произведений
+// в uint64_t и только затем редуцируются. Блоки по k и j как в gemm_update.
+template<typename T>
+TDynamicMatrix<T> mod_gemm(const TDynamicMatrix<T>& A, const TDynamicMatrix<T>& B, const TModulus& m)
+{
+    size_t n = A.size();
+    if (B.size() != n) {
+        throw length_error("different matrix sizes");
+    }
+    std::vector<uint64_t> a = mod_residues(A, m), b = mod_residues(B, m), c(n * n, 0);
+    const size_t lazy = m.lazy_terms();
+    parallel_for(0, n, [&](size_t lo, size_t hi) {
+        for (size_t kb = 0; kb < n; kb += GEMM_BLOCK_K) {
+            size_t ke = min(n, kb + GEMM_BLOCK_K);
+            for (size_t jb = 0; jb < n; jb += GEMM_BLOCK_J) {
+                size_t je = min(n, jb + GEMM_BLOCK_J);
+                for (size_t i = lo; i < hi; i++) {
+                    uint64_t* ci = c.data() + i * n;
+                    const uint64_t* ai = a.data() + i * n;
+                    for (size_t ks = kb; ks < ke; ks += lazy) {
+                        size_t kse = min(ke, ks + lazy);
+                        for (size_t k = ks; k < kse; k++) {
+                            const uint64_t aik = ai[k];
+                            const uint64_t* bk = b.data() + k * n;
+                            for (size_t j = jb; j < je; j++)
+                                ci[j] += aik * bk[j];
+                        }
+                        for (size_t j = jb; j < je; j++)
+                            ci[j] = m.reduce(ci[j]);
+                    }
+                }
+            }
+        }
+    }, n * n);
+    TDynamicMatrix<T> res(n);
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < n; j++)
+            res[i][j] = static_cast<T>(c[i * n + j]);
+    return res;
+}
+
+// Исключение Гаусса по модулю над M (rows x cols по строкам); ведущие
+// элементы ищутся в первых pcols столбцах. При jordan ведущие строки
+// нормируются и исключение идет также выше ведущей строки.
+struct TModElimination
+{
+    size_t rank;
+    uint64_t det; // произведение ведущих элементов с учетом перестановок
+};
+
+inline TModElimination mod_eliminate(std::vector<uint64_t>& M, size_t rows, size_t cols,
+    size_t pcols, const TModulus& m, bool jordan)
+{
+    const uint64_t p = m.value();
+    uint64_t det = 1;
+    size_t r = 0;
+    for (size_t c = 0; c < pcols && r < rows; c++) {
+        size_t q = r;
+        while (q < rows && M[q * cols + c] == 0)
+            q++;
+        if (q == rows)
+            continue;
+        if (q != r) {
+            std::swap_ranges(M.begin() + q * cols, M.begin() + (q + 1) * cols, M.begin() + r * cols);
+            det = p - det;
+        }
+        uint64_t* pr = M.data() + r * cols;
+        det = m.mul(det, pr[c]);
+        const uint64_t inv = m.inv(pr[c]);
+        if (jordan) {
+            for (size_t j = c; j < cols; j++)
+                pr[j] = m.mul(pr[j], inv);
+        }
+        size_t from = jordan ? 0 : r + 1;
+        parallel_for(from, rows, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++) {
+                uint64_t* row = M.data() + i * cols;
+                if (i == r || row[c] == 0)
+                    continue;
+                const uint64_t f = p - (jordan ? row[c] : m.mul(row[c], inv));
+                for (size_t j = c + 1; j < cols; j++)
+                    row[j] = m.reduce(row[j] + f * pr[j]);
+                row[c] = 0;
+            }
+        }, cols - c);
+        r++;
+    }
+    TModElimination res;
+    res.rank = r;
+    res.det = (r == rows) ? det : 0;
+    return res;
+}
+
+template<typename T>
+size_t mod_rank(const TDynamicMatrix<T>& A, const TModulus& m)
+{
+    std::vector<uint64_t> M = mod_residues(A, m);
+    return mod_eliminate(M, A.size(), A.size(), A.size(), m, false).rank;
+}
+
+template<typename T>
+uint64_t mod_det(const TDynamicMatrix<T>& A, const TModulus& m)
+{
+    std::vector<uint64_t> M = mod_residues(A, m);
+    return mod_eliminate(M, A.size(), A.size(), A.size(), m, false).det;
+}
+
+// обращение методом Гаусса-Жордана над [A | E]
+template<typename T>
+TDynamicMatrix<T> mod_inverse(const TDynamicMatrix<T>& A, const TModulus& m)
+{
+    size_t n = A.size(), w = 2 * n;
+    std::vector<uint64_t> a = mod_residues(A, m), M(n * w, 0);
+    for (size_t i = 0; i < n; i++) {
+        std::copy(a.begin() + i * n, a.begin() + (i + 1) * n, M.begin() + i * w);
+        M[i * w + n + i] = 1;
+    }
+    if (mod_eliminate(M, n, w, n, m, true).rank != n)
+        throw domain_error("matrix is singular modulo p");
+    TDynamicMatrix<T> res(n);
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < n; j++)
+            res[i][j] = static_cast<T>(M[i * w + n + j]);
+    return res;
+}
+
+// Многомодульный определитель: det вычисляется по нескольким простым
+// параллельно и восстанавливается по КТО (алгоритм Гарнера в
+// уравновешенной смешанной системе счисления). Число модулей выбирается
+// по оценке Адамара H так, чтобы их произведение превышало 2 * H, поэтому
+// результат точен; если модулей CRT_PRIMES не хватает, определитель
+// считается методом Барейса (overflow_error, если он не помещается в int64_t).
+const uint64_t CRT_PRIMES[] = { 2147483647, 2147483629, 2147483587, 2147483579,
+                                2147483563, 2147483549, 2147483543, 2147483497 };
+
+template<typename T>
+int64_t det_multimodular(const TDynamicMatrix<T>& A)
+{
+    static_assert(is_integral<T>::value, "multimodular determinant requires an integral type");
+    size_t n = A.size();
+    double log2h = 0;
+    for (size_t i = 0; i < n; i++) {
+        double s = 0;
+        for (size_t j = 0; j < n; j++)
+            s += (double)A[i][j] * (double)A[i][j];
+        if (s == 0)
+            return 0;
+        log2h += 0.5 * log2(s);
+    }
+    // 2^30.9 на модуль: нужно произведение > 2 * H
+    size_t total = (size_t)((log2h + 1) / 30.9) + 1;
+    if (total > sizeof(CRT_PRIMES) / sizeof(CRT_PRIMES[0]))
+        return det_bareiss(A);
+
+    // параллелится один уровень: модули, если их хватает на все потоки,
+    // иначе исключение внутри mod_det по очереди для каждого модуля
+    std::vector<uint64_t> res(total);
+    if (total >= thread_count()) {
+        parallel_for(0, total, [&](size_t lo, size_t hi) {
+            for (size_t t = lo; t < hi; t++)
+                res[t] = mod_det(A, TModulus(CRT_PRIMES[t]));
+        }, n * n * n);
+    }
+    else {
+        for (size_t t = 0; t < total; t++)
+            res[t] = mod_det(A, TModulus(CRT_PRIMES[t]));
+    }
+
+    // цифры Гарнера c_t в (-p_t/2, p_t/2]
+    std::vector<int64_t> digit(total);
+    for (size_t t = 0; t < total; t++) {
+        const uint64_t p = CRT_PRIMES[t];
+        uint64_t acc = 0, radix = 1;
+        for (size_t s = 0; s < t; s++) {
+            acc = (acc + to_residue(digit[s], p) * radix) % p;
+            radix = radix * (CRT_PRIMES[s] % p) % p;
+        }
+        uint64_t c = (res[t] + p - acc) % p * mod_inv(radix, p) % p;
+        digit[t] = c > p / 2 ? (int64_t)c - (int64_t)p : (int64_t)c;
+    }
+    int64_t det = 0;
+    for (size_t t = total; t-- > 0; ) {
+        if (!checked_mul(det, (int64_t)CRT_PRIMES[t], det) || !checked_add(det, digit[t], det))
+            throw overflow_error("determinant does not fit in int64_t");
+    }
+    return det;
+}
+
+// Быстрый текстовый ввод
+// Файл читается целиком крупными блоками, делится на строки, строки
+// разбираются std::from_chars (без локали) параллельно и пишутся сразу в
+// память строк матрицы. Формат - как у operator<<: строка текста - строка
+// матрицы, элементы разделены пробелами или табуляцией; пустые строки
+// пропускаются, порядок матрицы равен числу непустых строк.
+const size_t TEXT_READ_CHUNK = size_t(1) << 26;
+
+inline std::vector<char> read_file(const string& path)
+{
+    ifstream f(path, ios::binary);
+    if (!f) {
+        throw runtime_error("cannot open file " + path);
+    }
+    f.seekg(0, ios::end);
+    size_t len = (size_t)f.tellg();
+    f.seekg(0, ios::beg);
+    std::vector<char> buf(len);
+    for (size_t pos = 0; pos < len; pos += TEXT_READ_CHUNK) {
+        size_t part = min(TEXT_READ_CHUNK, len - pos);
+        if (!f.read(buf.data() + pos, (streamsize)part)) {
+            throw runtime_error("cannot read file " + path);
+        }
+    }
+    return buf;
+}
+
+inline bool is_text_space(char c) noexcept
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+// очередное число из [b, e) в x; false, если чисел больше нет
+template<typename T>
+bool parse_token(const char*& b, const char* e, T& x)
+{
+    static_assert(is_arithmetic<T>::value && !is_same<T, bool>::value, "text parsing requires a numeric type");
+    while (b < e && is_text_space(*b)) {
+        b++;
+    }
+    if (b == e) {
+        return false;
+    }
+    if (*b == '+') {
+        b++;
+    }
+    auto r = from_chars(b, e, x);
+    if (r.ec != errc() || (r.ptr < e && !is_text_space(*r.ptr))) {
+        throw invalid_argument("bad number: " + string(b, min<size_t>(e - b, 32)));
+    }
+    b = r.ptr;
+    return true;
+}
+
+// не более cap чисел из [b, e) в out, возвращает их количество
+template<typename T>
+size_t parse_numbers(const char* b, const char* e, T* out, size_t cap)
+{
+    size_t cnt = 0;
+    T x;
+    while (parse_token(b, e, x)) {
+        if (cnt == cap) {
+            throw invalid_argument("too many values in a line");
+        }
+        out[cnt++] = x;
+    }
+    return cnt;
+}
+
+// границы непустых строк текста
+inline std::vector<pair<const char*, const char*>> split_lines(const char* text, size_t len)
+{
+    std::vector<pair<const char*, const char*>> lines;
+    const char* end = text + len;
+    for (const char* b = text; b < end; ) {
+        const char* e = static_cast<const char*>(memchr(b, '\n', end - b));
+        if (!e) {
+            e = end;
+        }
+        if (std::find_if(b, e, [](char c) { return !is_text_space(c); }) != e) {
+            lines.emplace_back(b, e);
+        }
+        b = e + 1;
+    }
+    return lines;
+}
+
+template<typename T>
+TDynamicMatrix<T> parse_matrix(const char* text, size_t len)
+{
+    auto lines = split_lines(text, len);
+    if (lines.empty()) {
+        throw invalid_argument("empty matrix text");
+    }
+    size_t n = lines.size();
+    TDynamicMatrix<T> res(n);
+    parallel_for(0, n, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            if (parse_numbers(lines[i].first, lines[i].second, res[i].data(), n) != n) {
+                throw invalid_argument("matrix row " + to_string(i) + " is incomplete");
+            }
+        }
+    }, n * 16);
+    return res;
+}
+
+template<typename T>
+TDynamicMatrix<T> load_matrix_text(const string& path)
+{
+    std::vector<char> buf = read_file(path);
+    return parse_matrix<T>(buf.data(), buf.size());
+}
+
+// вектор - все числа текста; размер определяется подсчетом лексем
+template<typename T>
+TDynamicVector<T> parse_vector(const char* text, size_t len)
+{
+    auto lines = split_lines(text, len);
+    std::vector<size_t> offs(lines.size() + 1, 0);
+    for (size_t i = 0; i < lines.size(); i++) {
+        size_t cnt = 0;
+        for (const char* p = lines[i].first; p < lines[i].second; ) {
+            while (p < lines[i].second && is_text_space(*p)) {
+                p++;
+            }
+            if (p == lines[i].second) {
+                break;
+            }
+            cnt++;
+            while (p < lines[i].second && !is_text_space(*p)) {
+                p++;
+            }
+        }
+        offs[i + 1] = offs[i] + cnt;
+    }
+    if (offs.back() == 0) {
+        throw invalid_argument("empty vector text");
+    }
+    TDynamicVector<T> res(offs.back());
+    parallel_for(0, lines.size(), [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            parse_numbers(lines[i].first, lines[i].second, res.data() + offs[i], offs[i + 1] - offs[i]);
+        }
+    }, offs.back() / lines.size() * 16 + 1);
+    return res;
+}
+
+template<typename T>
+TDynamicVector<T> load_vector_text(const string& path)
+{
+    std::vector<char> buf = read_file(path);
+    return parse_vector<T>(buf.data(), buf.size());
+}
+
+// Быстрый текстовый вывод
+// Числа форматируются std::to_chars (кратчайшая запись, читается обратно
+// parse_matrix без потерь) в большие буферы, каждый буфер - один вызов
+// write. При TExecution::par блоки строк форматируются параллельно и
+// выводятся по порядку.
+const size_t TEXT_WRITE_BUFFER = size_t(1) << 22;
+const size_t TEXT_NUMBER_CHARS = 64;
+
+template<typename T>
+char* format_numbers(const T* p, size_t n, char* out)
+{
+    static_assert(is_arithmetic<T>::value && !is_same<T, bool>::value, "text formatting requires a numeric type");
+    for (size_t i = 0; i < n; i++) {
+        if (i) {
+            *out++ = ' ';
+        }
+        out = to_chars(out, out + TEXT_NUMBER_CHARS, p[i]).ptr;
+    }
+    *out++ = '\n';
+    return out;
+}
+
+inline void write_buffer(ostream& os, const char* b, const char* e)
+{
+    if (!os.write(b, e - b)) {
+        throw runtime_error("text output failed");
+    }
+}
+
+// буфер последовательного текстового вывода (вектор, Matrix Market):
+// числа через to_chars, запись блоками; остаток выводится явным flush.
+// Матрица по строкам форматируется параллельно через format_numbers.
+class TTextWriter
+{
+    ostream& os;
+    std::vector<char> buf;
+    size_t used = 0;
+public:
+    explicit TTextWriter(ostream& out) : os(out), buf(TEXT_WRITE_BUFFER + TEXT_NUMBER_CHARS) {}
+    TTextWriter& operator<<(const string& s)
+    {
+        for (size_t p = 0; p < s.size(); p += TEXT_NUMBER_CHARS) {
+            size_t part = min(TEXT_NUMBER_CHARS, s.size() - p);
+            memcpy(buf.data() + used, s.data() + p, part);
+            used += part;
+            reserve();
+        }
+        return *this;
+    }
+    TTextWriter& operator<<(char c)
+    {
+        buf[used++] = c;
+        reserve();
+        return *this;
+    }
+    template<typename T>
+    TTextWriter& number(T x)
+    {
+        used = to_chars(buf.data() + used, buf.data() + buf.size(), x).ptr - buf.data();
+        reserve();
+        return *this;
+    }
+    void reserve()
+    {
+        if (used >= TEXT_WRITE_BUFFER) {
+            flush();
+        }
+    }
+    void flush()
+    {
+        if (used) {
+            write_buffer(os, buf.data(), buf.data() + used);
+            used = 0;
+        }
+    }
+};
+
+template<typename T>
+void write_matrix_text(ostream& os, const TDynamicMatrix<T>& m, TExecution ex = TExecution::seq)
+{
+    size_t n = m.size();
+    size_t row_max = n * TEXT_NUMBER_CHARS + 1;
+    size_t rows = max<size_t>(1, TEXT_WRITE_BUFFER / row_max);
+    size_t blocks = (n + rows - 1) / rows;
+    size_t nb = ex == TExecution::par ? min(thread_count(), blocks) : 1;
+    std::vector<std::vector<char>> bufs(nb, std::vector<char>(rows * row_max));
+    std::vector<char*> ends(nb);
+    for (size_t b0 = 0; b0 < blocks; b0 += nb) {
+        size_t b1 = min(blocks, b0 + nb);
+        parallel_for(b0, b1, [&](size_t lo, size_t hi) {
+            for (size_t b = lo; b < hi; b++) {
+                char* out = bufs[b - b0].data();
+                for (size_t i = b * rows; i < min(n, (b + 1) * rows); i++) {
+                    out = format_numbers(m[i].data(), n, out);
+                }
+                ends[b - b0] = out;
+            }
+        }, PARALLEL_MIN_WORK);
+        for (size_t b = b0; b < b1; b++) {
+            write_buffer(os, bufs[b - b0].data(), ends[b - b0]);
+        }
+    }
+}
+
+// вектор выводится одной строкой
+template<typename T>
+void write_vector_text(ostream& os, const TDynamicVector<T>& v)
+{
+    TTextWriter w(os);
+    for (size_t i = 0; i < v.size(); i++) {
+        if (i) {
+            w << ' ';
+        }
+        w.number(v[i]);
+    }
+    w << '\n';
+    w.flush();
+}
+
+template<typename T>
+void save_matrix_text(const string& path, const TDynamicMatrix<T>& m, TExecution ex = TExecution::seq)
+{
+    ofstream f(path, ios::binary);
+    if (!f) {
+        throw runtime_error("cannot create file " + path);
+    }
+    write_matrix_text(f, m, ex);
+}
+
+template<typename T>
+void save_vector_text(const string& path, const TDynamicVector<T>& v)
+{
+    ofstream f(path, ios::binary);
+    if (!f) {
+        throw runtime_error("cannot create file " + path);
+    }
+    write_vector_text(f, v);
+}
+
+// Двоичный формат
+// Файл: заголовок TBinaryHeader (64 байта) и данные с data_offset по строкам
+// (или по столбцам при layout = 1). Поля заголовка и данные записаны в
+// порядке байт записавшей машины, он определяется по полю endian. Матрица
+// и вектор загружаются отображением файла в память (MAP_PRIVATE): строки
+// становятся представлениями над страницами файла, которые подгружаются по
+// первому обращению, изменения в памяти на файл не влияют. Если данные
+// требуют преобразования (другой порядок байт, по столбцам) или система не
+// поддерживает mmap, файл читается в обычную память.
+const char BINARY_MAGIC[8] = { 'T', 'M', 'A', 'T', 'B', 'I', 'N', 0 };
+const uint32_t BINARY_VERSION = 1;
+const uint32_t BINARY_ENDIAN_TAG = 0x01020304;
+const size_t BINARY_CHECK_BLOCK = size_t(1) << 20;
+
+struct TBinaryHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint32_t dtype;        // dtype_code<T>()
+    uint32_t layout;       // 0 - по строкам, 1 - по столбцам, 2 - плитками, 3 - сжатый
+    uint64_t rows;
+    uint64_t cols;         // 0 - вектор из rows элементов
+    uint64_t data_offset;
+    uint64_t checksum;     // data_checksum от данных в том виде, как они записаны
+    uint64_t reserved;     // размер плитки (layout = 2) или блока (layout = 3)
+};
+static_assert(sizeof(TBinaryHeader) == 64, "binary header must be 64 bytes");
+
+// код типа: 1 + 2 * log2(sizeof) + беззнаковость для целых, 9/10 - float/double
+template<typename T>
+constexpr uint32_t dtype_code() noexcept
+{
+    return is_floating_point<T>::value ? (sizeof(T) == 4 ? 9 : sizeof(T) == 8 ? 10 : 0)
+        : !is_integral<T>::value || is_same<T, bool>::value ? 0
+        : 1 + 2 * (sizeof(T) == 1 ? 0 : sizeof(T) == 2 ? 1 : sizeof(T) == 4 ? 2 : 3)
+            + (is_unsigned<T>::value ? 1 : 0);
+}
+
+template<typename T>
+T byte_swapped(T x) noexcept
+{
+    unsigned char b[sizeof(T)];
+    memcpy(b, &x, sizeof(T));
+    std::reverse(b, b + sizeof(T));
+    memcpy(&x, b, sizeof(T));
+    return x;
+}
+
+// хеш отрезка: 64-битные слова в порядке little-endian, умножение и сдвиг
+inline uint64_t hash_bytes(const void* data, size_t len) noexcept
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t h = 0xcbf29ce484222325ULL ^ len;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w = 0;
+        for (int k = 7; k >= 0; k--) {
+            w = (w << 8) | p[i + k];
+        }
+        h = (h ^ w) * 0x100000001b3ULL;
+        h ^= h >> 29;
+    }
+    uint64_t w = 0;
+    for (size_t k = len; k > i; k--) {
+        w = (w << 8) | p[k - 1];
+    }
+    h = (h ^ w) * 0x100000001b3ULL;
+    return h ^ (h >> 32);
+}
+
+// контрольная сумма: хеши отрезков (строк матрицы или блоков вектора по
+// BINARY_CHECK_BLOCK байт), свернутые по порядку
+inline uint64_t fold_hashes(const std::vector<uint64_t>& parts) noexcept
+{
+    uint64_t h = 0x9e3779b97f4a7c15ULL;
+    for (uint64_t x : parts) {
+        h = (h ^ x) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+    }
+    return h;
+}
+
+inline uint64_t data_checksum(const unsigned char* data, uint64_t rows, uint64_t cols, size_t elem)
+{
+    size_t seg = cols ? size_t(cols) * elem : BINARY_CHECK_BLOCK;
+    size_t total = size_t(rows) * (cols ? size_t(cols) : 1) * elem;
+    std::vector<uint64_t> parts((total + seg - 1) / seg);
+    parallel_for(0, parts.size(), [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            parts[i] = hash_bytes(data + i * seg, min(seg, total - i * seg));
+        }
+    }, seg);
+    return fold_hashes(parts);
+}
+
+template<typename T>
+uint64_t data_checksum(const TDynamicMatrix<T>& m)
+{
+    std::vector<uint64_t> parts(m.size());
+    parallel_for(0, m.size(), [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            parts[i] = hash_bytes(m[i].data(), m.size() * sizeof(T));
+        }
+    }, m.size() * sizeof(T));
+    return fold_hashes(parts);
+}
+
+template<typename T>
+TBinaryHeader make_binary_header(uint64_t rows, uint64_t cols)
+{
+    static_assert(dtype_code<T>() != 0, "binary format supports integer and floating types only");
+    TBinaryHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BINARY_MAGIC, sizeof(h.magic));
+    h.version = BINARY_VERSION;
+    h.endian = BINARY_ENDIAN_TAG;
+    h.dtype = dtype_code<T>();
+    h.rows = rows;
+    h.cols = cols;
+    h.data_offset = sizeof(TBinaryHeader);
+    return h;
+}
+
+template<typename T>
+void save_matrix_binary(const string& path, const TDynamicMatrix<T>& m)
+{
+    TBinaryHeader h = make_binary_header<T>(m.size(), m.size());
+    h.checksum = data_checksum(m);
+    ofstream f(path, ios::binary);
+    if (!f || !f.write(reinterpret_cast<const char*>(&h), sizeof(h))) {
+        throw runtime_error("cannot write file " + path);
+    }
+    for (size_t i = 0; i < m.size(); i++) {
+        if (!f.write(reinterpret_cast<const char*>(m[i].data()), m.size() * sizeof(T))) {
+            throw runtime_error("cannot write file " + path);
+        }
+    }
+}
+
+template<typename T>
+void save_vector_binary(const string& path, const TDynamicVector<T>& v)
+{
+    TBinaryHeader h = make_binary_header<T>(v.size(), 0);
+    h.checksum = data_checksum(reinterpret_cast<const unsigned char*>(v.data()), v.size(), 0, sizeof(T));
+    ofstream f(path, ios::binary);
+    if (!f || !f.write(reinterpret_cast<const char*>(&h), sizeof(h))
+        || !f.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T))) {
+        throw runtime_error("cannot write file " + path);
+    }
+}
+
+// отображение файла в память. По умолчанию - частное (MAP_PRIVATE), на
+// системах без mmap файл читается в кучу; shared - общее с файлом и другими
+// процессами (MAP_SHARED), writable = false - только чтение
+inline shared_ptr<void> map_file(const string& path, size_t& len, bool shared = false, bool writable = true)
+{
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), shared && writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("cannot open file " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        throw runtime_error("cannot map empty file " + path);
+    }
+    len = size_t(st.st_size);
+    void* addr = mmap(nullptr, len, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+        shared ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        throw runtime_error("cannot map file " + path);
+    }
+    return shared_ptr<void>(addr, [len](void* p) { munmap(p, len); });
+#else
+    if (shared) {
+        throw runtime_error("shared file mapping is not supported on this platform");
+    }
+    std::vector<char> buf = read_file(path);
+    len = buf.size();
+    shared_ptr<std::vector<char>> keep = make_shared<std::vector<char>>(std::move(buf));
+    return shared_ptr<void>(keep, keep->data());
+#endif
+}
+
+// проверка заголовка; в h поля приводятся к порядку байт этой машины
+template<typename T>
+bool check_binary_header(TBinaryHeader& h, size_t len, bool matrix)
+{
+    if (len < sizeof(TBinaryHeader) || memcmp(h.magic, BINARY_MAGIC, sizeof(h.magic)) != 0) {
+        throw invalid_argument("not a tmatrix binary file");
+    }
+    bool swapped = h.endian == byte_swapped(BINARY_ENDIAN_TAG);
+    if (swapped) {
+        h.version = byte_swapped(h.version);
+        h.dtype = byte_swapped(h.dtype);
+        h.layout = byte_swapped(h.layout);
+        h.rows = byte_swapped(h.rows);
+        h.cols = byte_swapped(h.cols);
+        h.data_offset = byte_swapped(h.data_offset);
+        h.checksum = byte_swapped(h.checksum);
+    }
+    else if (h.endian != BINARY_ENDIAN_TAG) {
+        throw invalid_argument("bad byte order tag");
+    }
+    if (h.version != BINARY_VERSION) {
+        throw invalid_argument("unsupported binary format version");
+    }
+    if (h.dtype != dtype_code<T>()) {
+        throw invalid_argument("element type does not match the file");
+    }
+    if (matrix ? h.cols != h.rows : h.cols != 0) {
+        throw length_error(matrix ? "bad matrix size" : "bad vector size");
+    }
+    if (h.layout > 1 || h.data_offset < sizeof(TBinaryHeader) || h.data_offset % sizeof(T) != 0) {
+        throw invalid_argument("bad binary header");
+    }
+    if (h.rows == 0 || h.rows > uint64_t(matrix ? MAX_MATRIX_SIZE : MAX_VECTOR_SIZE) || h.data_offset > len
+        || h.rows * (matrix ? h.rows : 1) * sizeof(T) > len - h.data_offset) {
+        throw length_error("bad binary file size");
+    }
+    return swapped;
+}
+
+inline void verify_binary_data(const TBinaryHeader& h, const void* data, size_t elem)
+{
+    if (data_checksum(static_cast<const unsigned char*>(data), h.rows, h.cols, elem) != h.checksum) {
+        throw runtime_error("binary data checksum mismatch");
+    }
+}
+
+// verify - проверить контрольную сумму (читает все данные файла)
+template<typename T>
+TDynamicMatrix<T> load_matrix_binary(const string& path, bool verify = false)
+{
+    size_t len = 0;
+    shared_ptr<void> file = map_file(path, len);
+    TBinaryHeader h;
+    memcpy(&h, file.get(), sizeof(h));
+    bool swapped = check_binary_header<T>(h, len, true);
+    T* data = reinterpret_cast<T*>(static_cast<char*>(file.get()) + h.data_offset);
+    if (verify) {
+        verify_binary_data(h, data, sizeof(T));
+    }
+    size_t n = size_t(h.rows);
+    if (!swapped && h.layout == 0) {
+        return TDynamicMatrix<T>(data, n, file);
+    }
+    TDynamicMatrix<T> res(n);
+    parallel_for(0, n, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            T* r = res[i].data();
+            for (size_t j = 0; j < n; j++) {
+                T x = h.layout == 0 ? data[i * n + j] : data[j * n + i];
+                r[j] = swapped ? byte_swapped(x) : x;
+            }
+        }
+    }, n);
+    return res;
+}
+
+template<typename T>
+TDynamicVector<T> load_vector_binary(const string& path, bool verify = false)
+{
+    size_t len = 0;
+    shared_ptr<void> file = map_file(path, len);
+    TBinaryHeader h;
+    memcpy(&h, file.get(), sizeof(h));
+    bool swapped = check_binary_header<T>(h, len, false);
+    T* data = reinterpret_cast<T*>(static_cast<char*>(file.get()) + h.data_offset);
+    if (verify) {
+        verify_binary_data(h, data, sizeof(T));
+    }
+    size_t n = size_t(h.rows);
+    if (!swapped) {
+        return TDynamicVector<T>(data, n, file);
+    }
+    TDynamicVector<T> res(n);
+    for (size_t i = 0; i < n; i++) {
+        res[i] = byte_swapped(data[i]);
+    }
+    return res;
+}
+
+// Формат NumPy .npy / .npz
+// .npy: "\x93NUMPY", версия, длина заголовка, словарь Python с descr,
+// fortran_order и shape, затем данные. Поддерживаются целые и вещественные
+// dtype любого порядка байт; матрица - двумерный квадратный массив, вектор -
+// одномерный. Если тип, порядок байт и порядок хранения совпадают с нашими,
+// массив загружается без копирования как представление над отображенным
+// файлом, иначе - с преобразованием. .npz - zip-архив из .npy, читаются
+// только несжатые записи (np.savez), np.savez_compressed не поддерживается.
+const unsigned char NPY_MAGIC[6] = { 0x93, 'N', 'U', 'M', 'P', 'Y' };
+const size_t NPY_ALIGN = 64;
+
+inline bool host_little_endian() noexcept
+{
+    const uint16_t one = 1;
+    unsigned char b;
+    memcpy(&b, &one, 1);
+    return b == 1;
+}
+
+// разобранный заголовок .npy
+struct TNpyArray
+{
+    uint32_t dtype = 0;          // dtype_code
+    size_t elem = 0;
+    bool swapped = false;        // порядок байт отличается от нашего
+    bool fortran = false;
+    std::vector<size_t> shape;
+    const unsigned char* data = nullptr;
+    size_t count = 0;
+};
+
+template<typename T>
+string npy_descr()
+{
+    static_assert(dtype_code<T>() != 0, "npy supports integer and floating types only");
+    char kind = is_floating_point<T>::value ? 'f' : is_unsigned<T>::value ? 'u' : 'i';
+    char order = sizeof(T) == 1 ? '|' : host_little_endian() ? '<' : '>';
+    return string(1, order) + kind + to_string(sizeof(T));
+}
+
+inline void write_npy_header(ostream& os, const string& descr, bool fortran, const std::vector<size_t>& shape)
+{
+    string dict = "{'descr': '" + descr + "', 'fortran_order': " + (fortran ? "True" : "False") + ", 'shape': (";
+    for (size_t i = 0; i < shape.size(); i++) {
+        dict += (i ? ", " : "") + to_string(shape[i]);
+    }
+    dict += shape.size() == 1 ? ",), }" : "), }";
+    bool v2 = dict.size() + 12 > 65535;
+    size_t prefix = v2 ? 12 : 10;
+    dict.append(NPY_ALIGN - (prefix + dict.size() + 1) % NPY_ALIGN, ' ');
+    dict += '\n';
+    unsigned char head[12];
+    memcpy(head, NPY_MAGIC, 6);
+    head[6] = v2 ? 2 : 1;
+    head[7] = 0;
+    for (size_t i = 0; i < prefix - 8; i++) {
+        head[8 + i] = (unsigned char)(dict.size() >> (8 * i));
+    }
+    if (!os.write(reinterpret_cast<const char*>(head), prefix) || !os.write(dict.data(), dict.size())) {
+        throw runtime_error("npy output failed");
+    }
+}
+
+template<typename T>
+void save_npy(const string& path, const TDynamicMatrix<T>& m)
+{
+    ofstream f(path, ios::binary);
+    if (!f) {
+        throw runtime_error("cannot create file " + path);
+    }
+    write_npy_header(f, npy_descr<T>(), false, { m.size(), m.size() });
+    for (size_t i = 0; i < m.size(); i++) {
+        if (!f.write(reinterpret_cast<const char*>(m[i].data()), m.size() * sizeof(T))) {
+            throw runtime_error("cannot write file " + path);
+        }
+    }
+}
+
+template<typename T>
+void save_npy(const string& path, const TDynamicVector<T>& v)
+{
+    ofstream f(path, ios::binary);
+    if (!f) {
+        throw runtime_error("cannot create file " + path);
+    }
+    write_npy_header(f, npy_descr<T>(), false, { v.size() });
+    if (!f.write(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T))) {
+        throw runtime_error("cannot write file " + path);
+    }
+}
+
+// значение ключа key в словаре заголовка
+inline string npy_dict_value(const string& dict, const string& key)
+{
+    size_t p = dict.find("'" + key + "'");
+    if (p == string::npos || (p = dict.find(':', p)) == string::npos) {
+        throw invalid_argument("npy header has no " + key);
+    }
+    p = dict.find_first_not_of(' ', p + 1);
+    if (p == string::npos) {
+        throw invalid_argument("bad npy header");
+    }
+    size_t e = dict[p] == '(' ? dict.find(')', p) + 1
+        : dict[p] == '\'' ? dict.find('\'', p + 1) + 1 : dict.find_first_of(",}", p);
+    if (e == string::npos || e == 0) {
+        throw invalid_argument("bad npy header");
+    }
+    return dict.substr(p, e - p);
+}
+
+inline TNpyArray parse_npy(const unsigned char* p, size_t len)
+{
+    if (len < 10 || memcmp(p, NPY_MAGIC, 6) != 0) {
+        throw invalid_argument("not an npy array");
+    }
+    size_t prefix = p[6] == 1 ? 10 : 12;
+    if (p[6] < 1 || p[6] > 3 || len < prefix) {
+        throw invalid_argument("unsupported npy version");
+    }
+    size_t hlen = 0;
+    for (size_t i = prefix; i > 8; i--) {
+        hlen = (hlen << 8) | p[i - 1];
+    }
+    if (prefix + hlen > len) {
+        throw invalid_argument("bad npy header");
+    }
+    string dict(reinterpret_cast<const char*>(p) + prefix, hlen);
+    TNpyArray a;
+    string descr = npy_dict_value(dict, "descr");
+    if (descr.size() < 5 || descr.find_first_of("<>|=", 1) != 1) {
+        throw invalid_argument("unsupported npy dtype " + descr);
+    }
+    char order = descr[1], kind = descr[2];
+    a.elem = size_t(atoi(descr.c_str() + 3));
+    bool little = order == '<' || (order == '=' && host_little_endian());
+    a.swapped = a.elem > 1 && order != '|' && little != host_little_endian();
+    uint32_t lg = a.elem == 1 ? 0 : a.elem == 2 ? 1 : a.elem == 4 ? 2 : a.elem == 8 ? 3 : 4;
+    if ((kind == 'i' || kind == 'u' || kind == 'b') && lg < 4) {
+        a.dtype = 1 + 2 * lg + (kind == 'i' ? 0 : 1);
+    }
+    else if (kind == 'f' && (a.elem == 4 || a.elem == 8)) {
+        a.dtype = a.elem == 4 ? 9 : 10;
+    }
+    else {
+        throw invalid_argument("unsupported npy dtype " + descr);
+    }
+    a.fortran = npy_dict_value(dict, "fortran_order") == "True";
+    string shape = npy_dict_value(dict, "shape");
+    a.count = 1;
+    for (size_t i = 1; i < shape.size(); ) {
+        size_t v = 0;
+        auto r = from_chars(shape.data() + i, shape.data() + shape.size(), v);
+        if (r.ec == errc()) {
+            a.shape.push_back(v);
+            a.count *= v;
+            i = r.ptr - shape.data();
+        }
+        else {
+            i++;
+        }
+    }
+    a.data = p + prefix + hlen;
+    if (size_t(len - prefix - hlen) / a.elem < a.count) {
+        throw length_error("npy data is truncated");
+    }
+    return a;
+}
+
+template<typename T, typename S, typename F>
+void npy_copy_as(const TNpyArray& a, size_t rows, size_t cols, F row)
+{
+    parallel_for(0, rows, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            T* r = row(i);
+            for (size_t j = 0; j < cols; j++) {
+                S x;
+                memcpy(&x, a.data + (a.fortran ? j * rows + i : i * cols + j) * sizeof(S), sizeof(S));
+                r[j] = T(a.swapped ? byte_swapped(x) : x);
+            }
+        }
+    }, cols * 2);
+}
+
+// копия массива с приведением к T; row(i) - память i-й строки результата
+template<typename T, typename F>
+void npy_copy(const TNpyArray& a, size_t rows, size_t cols, F row)
+{
+    switch (a.dtype) {
+    case dtype_code<int8_t>(): npy_copy_as<T, int8_t>(a, rows, cols, row); break;
+    case dtype_code<uint8_t>(): npy_copy_as<T, uint8_t>(a, rows, cols, row); break;
+    case dtype_code<int16_t>(): npy_copy_as<T, int16_t>(a, rows, cols, row); break;
+    case dtype_code<uint16_t>(): npy_copy_as<T, uint16_t>(a, rows, cols, row); break;
+    case dtype_code<int32_t>(): npy_copy_as<T, int32_t>(a, rows, cols, row); break;
+    case dtype_code<uint32_t>(): npy_copy_as<T, uint32_t>(a, rows, cols, row); break;
+    case dtype_code<int64_t>(): npy_copy_as<T, int64_t>(a, rows, cols, row); break;
+    case dtype_code<uint64_t>(): npy_copy_as<T, uint64_t>(a, rows, cols, row); break;
+    case dtype_code<float>(): npy_copy_as<T, float>(a, rows, cols, row); break;
+    default: npy_copy_as<T, double>(a, rows, cols, row); break;
+    }
+}
+
+template<typename T>
+bool npy_direct(const TNpyArray& a)
+{
+    return a.dtype == dtype_code<T>() && !a.swapped
+        && reinterpret_cast<uintptr_t>(a.data) % alignof(T) == 0;
+}
+
+// keep - владелец памяти a.data, для загрузки без копирования
+template<typename T>
+TDynamicMatrix<T> npy_matrix(const TNpyArray& a, const shared_ptr<void>& keep)
+{
+    if (a.shape.size() != 2 || a.shape[0] != a.shape[1]) {
+        throw length_error("npy array is not a square matrix");
+    }
+    size_t n = a.shape[0];
+    if (npy_direct<T>(a) && (!a.fortran || n == 1)) {
+        return TDynamicMatrix<T>(const_cast<T*>(reinterpret_cast<const T*>(a.data)), n, keep);
+    }
+    TDynamicMatrix<T> res(n);
+    npy_copy<T>(a, n, n, [&](size_t i) { return res[i].data(); });
+    return res;
+}
+
+template<typename T>
+TDynamicVector<T> npy_vector(const TNpyArray& a, const shared_ptr<void>& keep)
+{
+    if (a.shape.size() != 1) {
+        throw length_error("npy array is not a vector");
+    }
+    if (npy_direct<T>(a)) {
+        return TDynamicVector<T>(const_cast<T*>(reinterpret_cast<const T*>(a.data)), a.count, keep);
+    }
+    TDynamicVector<T> res(a.count);
+    npy_copy<T>(a, a.count, 1, [&](size_t i) { return res.data() + i; });
+    return res;
+}
+
+template<typename T>
+TDynamicMatrix<T> load_npy_matrix(const string& path)
+{
+    size_t len = 0;
+    shared_ptr<void> file = map_file(path, len);
+    return npy_matrix<T>(parse_npy(static_cast<const unsigned char*>(file.get()), len), file);
+}
+
+template<typename T>
+TDynamicVector<T> load_npy_vector(const string& path)
+{
+    size_t len = 0;
+    shared_ptr<void> file = map_file(path, len);
+    return npy_vector<T>(parse_npy(static_cast<const unsigned char*>(file.get()), len), file);
+}
+
+// Архив .npz: оглавление zip (в том числе zip64) читается при открытии,
+// массивы - по имени без расширения .npy
+class TNpzArchive
+{
+    shared_ptr<void> file;
+    size_t len = 0;
+    std::vector<pair<string, size_t>> entries; // имя и смещение локального заголовка
+
+    static uint64_t le(const unsigned char* p, size_t bytes) noexcept
+    {
+        uint64_t v = 0;
+        for (size_t i = bytes; i > 0; i--) {
+            v = (v << 8) | p[i - 1];
+        }
+        return v;
+    }
+    const unsigned char* at(uint64_t off, uint64_t need) const
+    {
+        if (off > len || need > len - off) {
+            throw invalid_argument("bad npz archive");
+        }
+        return static_cast<const unsigned char*>(file.get()) + off;
+    }
+public:
+    explicit TNpzArchive(const string& path)
+    {
+        file = map_file(path, len);
+        size_t eocd = len < 22 ? 0 : len - 22;
+        while (eocd > 0 && le(at(eocd, 4), 4) != 0x06054b50) {
+            eocd--;
+        }
+        const unsigned char* e = at(eocd, 22);
+        if (le(e, 4) != 0x06054b50) {
+            throw invalid_argument("not an npz archive");
+        }
+        uint64_t count = le(e + 10, 2), dir = le(e + 16, 4);
+        if ((count == 0xffff || dir == 0xffffffff) && eocd >= 20 && le(at(eocd - 20, 4), 4) == 0x07064b50) {
+            const unsigned char* z = at(le(at(eocd - 20, 20) + 8, 8), 56);
+            count = le(z + 32, 8);
+            dir = le(z + 48, 8);
+        }
+        for (uint64_t k = 0; k < count; k++) {
+            const unsigned char* c = at(dir, 46);
+            if (le(c, 4) != 0x02014b50) {
+                throw invalid_argument("bad npz directory");
+            }
+            size_t nlen = size_t(le(c + 28, 2)), xlen = size_t(le(c + 30, 2)), clen = size_t(le(c + 32, 2));
+            uint64_t local = le(c + 42, 4);
+            const unsigned char* x = at(dir + 46 + nlen, xlen);
+            for (size_t q = 0; local == 0xffffffff && q + 4 <= xlen; q += 4 + size_t(le(x + q + 2, 2))) {
+                if (le(x + q, 2) == 1) {
+                    // поля zip64 идут по порядку, присутствуют только переполненные
+                    size_t off = q + 4 + (le(c + 24, 4) == 0xffffffff ? 8 : 0) + (le(c + 20, 4) == 0xffffffff ? 8 : 0);
+                    local = le(at(dir + 46 + nlen + off, 8), 8);
+                }
+            }
+            if (le(c + 10, 2) != 0) {
+                throw runtime_error("compressed npz entries are not supported");
+            }
+            string name(reinterpret_cast<const char*>(at(dir + 46, nlen)), nlen);
+            if (name.size() > 4 && name.compare(name.size() - 4, 4, ".npy") == 0) {
+                name.resize(name.size() - 4);
+            }
+            entries.emplace_back(name, size_t(local));
+            dir += 46 + nlen + xlen + clen;
+        }
+    }
+
+    std::vector<string> names() const
+    {
+        std::vector<string> res;
+        for (auto& e : entries) {
+            res.push_back(e.first);
+        }
+        return res;
+    }
+
+    TNpyArray array(const string& name) const
+    {
+        for (auto& e : entries) {
+            if (e.first == name) {
+                const unsigned char* h = at(e.second, 30);
+                if (le(h, 4) != 0x04034b50) {
+                    throw invalid_argument("bad npz entry " + name);
+                }
+                size_t start = e.second + 30 + size_t(le(h + 26, 2)) + size_t(le(h + 28, 2));
+                return parse_npy(at(start, 0), len - start);
+            }
+        }
+        throw out_of_range("no array " + name + " in npz archive");
+    }
+
+    template<typename T>
+    TDynamicMatrix<T> matrix(const string& name) const { return npy_matrix<T>(array(name), file); }
+    template<typename T>
+    TDynamicVector<T> vector(const string& name) const { return npy_vector<T>(array(name), file); }
+};
+
+// Разреженная матрица
+// Хранение CSR: для строки i столбцы col[rowptr[i]..rowptr[i+1]) по
+// возрастанию и значения val. У симметричной и кососимметричной матрицы
+// хранится только нижний треугольник, вторая половина получается при
+// обращении (at, for_each, умножение) без копирования.
+enum class TSymmetry { general, symmetric, skew };
+
+template<typename T>
+class TSparseMatrix
+{
+    size_t nr, nc;
+    TSymmetry sym;
+    std::vector<size_t> rowptr, col;
+    std::vector<T> val;
+
+    // хранимый элемент (i, j) или nullptr
+    const T* find(size_t i, size_t j) const
+    {
+        auto b = col.begin() + rowptr[i], e = col.begin() + rowptr[i + 1];
+        auto p = lower_bound(b, e, j);
+        return p != e && *p == j ? &val[p - col.begin()] : nullptr;
+    }
+public:
+    // тройки (ri[k], ci[k], v[k]), повторы складываются; у симметричных
+    // элементы верхнего треугольника переносятся в нижний
+    TSparseMatrix(size_t rows, size_t cols, TSymmetry s, std::vector<size_t> ri, std::vector<size_t> ci,
+        std::vector<T> v) : nr(rows), nc(cols), sym(s), rowptr(rows + 1, 0)
+    {
+        if (ri.size() != ci.size() || ri.size() != v.size()) {
+            throw length_error("different triplet sizes");
+        }
+        if (sym != TSymmetry::general && nr != nc) {
+            throw length_error("symmetric matrix must be square");
+        }
+        for (size_t k = 0; k < ri.size(); k++) {
+            if (ri[k] >= nr || ci[k] >= nc) {
+                throw out_of_range("sparse entry index is out of range");
+            }
+            if (sym != TSymmetry::general && ri[k] < ci[k]) {
+                swap(ri[k], ci[k]);
+                if (sym == TSymmetry::skew) {
+                    v[k] = -v[k];
+                }
+            }
+            if (sym == TSymmetry::skew && ri[k] == ci[k]) {
+                throw invalid_argument("skew-symmetric matrix has a diagonal entry");
+            }
+            rowptr[ri[k] + 1]++;
+        }
+        for (size_t i = 0; i < nr; i++) {
+            rowptr[i + 1] += rowptr[i];
+        }
+        std::vector<size_t> pos(rowptr.begin(), rowptr.end() - 1), perm(ri.size());
+        for (size_t k = 0; k < ri.size(); k++) {
+            perm[pos[ri[k]]++] = k;
+        }
+        std::vector<size_t> keep(nr, 0);
+        col.resize(ri.size());
+        val.resize(ri.size());
+        parallel_for(0, nr, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++) {
+                auto b = perm.begin() + rowptr[i], e = perm.begin() + rowptr[i + 1];
+                std::sort(b, e, [&](size_t x, size_t y) { return ci[x] < ci[y] || (ci[x] == ci[y] && x < y); });
+                size_t out = rowptr[i];
+                for (auto p = b; p != e; ++p) {
+                    if (out > rowptr[i] && col[out - 1] == ci[*p]) {
+                        val[out - 1] += v[*p];
+                    }
+                    else {
+                        col[out] = ci[*p];
+                        val[out++] = v[*p];
+                    }
+                }
+                keep[i] = out - rowptr[i];
+            }
+        }, 16);
+        // сжатие после слияния повторов
+        size_t out = 0;
+        for (size_t i = 0; i < nr; i++) {
+            size_t b = rowptr[i];
+            rowptr[i] = out;
+            std::move(col.begin() + b, col.begin() + b + keep[i], col.begin() + out);
+            std::move(val.begin() + b, val.begin() + b + keep[i], val.begin() + out);
+            out += keep[i];
+        }
+        rowptr[nr] = out;
+        col.resize(out);
+        val.resize(out);
+    }
+
+    // ненулевые элементы плотной матрицы
+    static TSparseMatrix from_dense(const TDynamicMatrix<T>& m)
+    {
+        std::vector<size_t> ri, ci;
+        std::vector<T> v;
+        for (size_t i = 0; i < m.size(); i++) {
+            for (size_t j = 0; j < m.size(); j++) {
+                if (m[i][j] != T()) {
+                    ri.push_back(i);
+                    ci.push_back(j);
+                    v.push_back(m[i][j]);
+                }
+            }
+        }
+        return TSparseMatrix(m.size(), m.size(), TSymmetry::general, std::move(ri), std::move(ci), std::move(v));
+    }
+
+    size_t rows() const noexcept { return nr; }
+    size_t cols() const noexcept { return nc; }
+    TSymmetry symmetry() const noexcept { return sym; }
+    // число хранимых элементов
+    size_t nnz() const noexcept { return val.size(); }
+
+    T at(size_t i, size_t j) const
+    {
+        if (i >= nr || j >= nc) {
+            throw out_of_range("sparse matrix index is out of range");
+        }
+        if (sym != TSymmetry::general && i < j) {
+            const T* p = find(j, i);
+            return p ? (sym == TSymmetry::skew ? -*p : *p) : T();
+        }
+        const T* p = find(i, j);
+        return p ? *p : T();
+    }
+
+    // f(i, j, value) для всех ненулевых элементов, включая симметричные
+    template<typename F>
+    void for_each(F f) const
+    {
+        for (size_t i = 0; i < nr; i++) {
+            for (size_t k = rowptr[i]; k < rowptr[i + 1]; k++) {
+                f(i, col[k], val[k]);
+                if (sym != TSymmetry::general && col[k] != i) {
+                    f(col[k], i, sym == TSymmetry::skew ? -val[k] : val[k]);
+                }
+            }
+        }
+    }
+    // только хранимые элементы
+    template<typename F>
+    void for_each_stored(F f) const
+    {
+        for (size_t i = 0; i < nr; i++) {
+            for (size_t k = rowptr[i]; k < rowptr[i + 1]; k++) {
+                f(i, col[k], val[k]);
+            }
+        }
+    }
+
+    TDynamicVector<T> operator*(const TDynamicVector<T>& x) const
+    {
+        if (x.size() != nc) {
+            throw length_error("bad vector size");
+        }
+        TDynamicVector<T> y(nr);
+        parallel_for(0, nr, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++) {
+                T s = T();
+                for (size_t k = rowptr[i]; k < rowptr[i + 1]; k++) {
+                    s += val[k] * x[col[k]];
+                }
+                y[i] = s;
+            }
+        }, nnz() / nr + 1);
+        if (sym != TSymmetry::general) {
+            // отраженная часть: y[j] += a(i, j) * x[i] над нижним треугольником
+            for (size_t i = 0; i < nr; i++) {
+                for (size_t k = rowptr[i]; k < rowptr[i + 1]; k++) {
+                    if (col[k] != i) {
+                        T t = val[k] * x[i];
+                        y[col[k]] += sym == TSymmetry::skew ? -t : t;
+                    }
+                }
+            }
+        }
+        return y;
+    }
+
+    TDynamicMatrix<T> to_dense() const
+    {
+        if (nr != nc) {
+            throw length_error("bad matrix size");
+        }
+        TDynamicMatrix<T> res(nr);
+        for_each([&](size_t i, size_t j, const T& v) { res[i][j] = v; });
+        return res;
+    }
+};
+
+// Формат Matrix Market (.mtx)
+// Заголовок "%%MatrixMarket matrix <coordinate|array> <real|integer|pattern>
+// <general|symmetric|skew-symmetric|hermitian>", комментарии '%', строка
+// размеров и данные: тройки "i j [v]" с индексами от 1 или значения по
+// столбцам (у симметричных - только нижний треугольник). Данные читаются
+// блоками по TEXT_READ_CHUNK, строки блока разбираются параллельно.
+struct TMatrixMarketHeader
+{
+    bool coordinate = true;
+    bool pattern = false;
+    bool integer = false;
+    TSymmetry symmetry = TSymmetry::general;
+    size_t rows = 0, cols = 0, entries = 0;
+};
+
+inline TMatrixMarketHeader read_matrix_market_header(istream& is)
+{
+    string line;
+    if (!getline(is, line)) {
+        throw invalid_argument("empty Matrix Market file");
+    }
+    std::transform(line.begin(), line.end(), line.begin(), [](char c) { return char(tolower((unsigned char)c)); });
+    std::vector<string> w;
+    for (const char* p = line.c_str(); *p; ) {
+        while (*p && is_text_space(*p)) p++;
+        const char* q = p;
+        while (*q && !is_text_space(*q)) q++;
+        if (q > p) w.emplace_back(p, q);
+        p = q;
+    }
+    if (w.size() != 5 || w[0] != "%%matrixmarket" || w[1] != "matrix") {
+        throw invalid_argument("not a Matrix Market matrix");
+    }
+    TMatrixMarketHeader h;
+    if (w[2] != "coordinate" && w[2] != "array") {
+        throw invalid_argument("unsupported Matrix Market format " + w[2]);
+    }
+    h.coordinate = w[2] == "coordinate";
+    if (w[3] != "real" && w[3] != "double" && w[3] != "integer" && w[3] != "pattern") {
+        throw invalid_argument("unsupported Matrix Market field " + w[3]);
+    }
+    h.pattern = w[3] == "pattern";
+    h.integer = w[3] == "integer";
+    if (h.pattern && !h.coordinate) {
+        throw invalid_argument("pattern field requires coordinate format");
+    }
+    if (w[4] == "symmetric" || w[4] == "hermitian") {
+        h.symmetry = TSymmetry::symmetric;
+    }
+    else if (w[4] == "skew-symmetric") {
+        h.symmetry = TSymmetry::skew;
+    }
+    else if (w[4] != "general") {
+        throw invalid_argument("unsupported Matrix Market symmetry " + w[4]);
+    }
+    while (getline(is, line)) {
+        const char* b = line.data();
+        const char* e = b + line.size();
+        while (b < e && is_text_space(*b)) b++;
+        if (b == e || *b == '%') {
+            continue;
+        }
+        size_t dims[3] = { 0, 0, 0 };
+        if (parse_numbers(b, e, dims, 3) != (h.coordinate ? 3u : 2u)) {
+            throw invalid_argument("bad Matrix Market size line");
+        }
+        h.rows = dims[0];
+        h.cols = dims[1];
+        // размеры проверяются до выделения памяти под данные
+        if (h.rows == 0 || h.cols == 0 || h.rows > size_t(MAX_VECTOR_SIZE) || h.cols > size_t(MAX_VECTOR_SIZE)) {
+            throw length_error("bad matrix size");
+        }
+        if (h.symmetry != TSymmetry::general && h.rows != h.cols) {
+            throw length_error("symmetric matrix must be square");
+        }
+        if (h.rows > SIZE_MAX / h.cols) {
+            throw length_error("Matrix Market matrix is too large");
+        }
+        size_t full = h.rows * h.cols;
+        size_t tri = h.symmetry == TSymmetry::symmetric ? full / 2 + h.rows / 2 + h.rows % 2
+            : h.symmetry == TSymmetry::skew ? full / 2 - h.rows / 2 : full;
+        if (h.coordinate && dims[2] > full) {
+            throw length_error("too many Matrix Market entries");
+        }
+        h.entries = h.coordinate ? dims[2] : tri;
+        return h;
+    }
+    throw invalid_argument("Matrix Market size line is missing");
+}
+
+// f(lines) для блоков целых непустых строк потока
+template<typename F>
+void for_each_line_block(istream& is, F f)
+{
+    std::vector<char> buf;
+    size_t tail = 0;
+    for (;;) {
+        buf.resize(tail + TEXT_READ_CHUNK);
+        is.read(buf.data() + tail, (streamsize)TEXT_READ_CHUNK);
+        size_t got = tail + size_t(is.gcount());
+        bool last = got < buf.size();
+        size_t cut = got;
+        if (!last) {
+            while (cut > 0 && buf[cut - 1] != '\n') {
+                cut--;
+            }
+            if (cut == 0) {
+                tail = got; // строка длиннее блока
+                continue;
+            }
+        }
+        f(split_lines(buf.data(), cut));
+        if (last) {
+            return;
+        }
+        std::copy(buf.begin() + cut, buf.begin() + got, buf.begin());
+        tail = got - cut;
+    }
+}
+
+// данные после заголовка: тройки координатного формата (индексы от 0)
+// или значения массива по столбцам
+template<typename T>
+void read_matrix_market_data(istream& is, const TMatrixMarketHeader& h,
+    std::vector<size_t>& ri, std::vector<size_t>& ci, std::vector<T>& v)
+{
+    // память растет по мере чтения блоков: число элементов из заголовка
+    // не заверено данными
+    size_t done = 0;
+    for_each_line_block(is, [&](const std::vector<pair<const char*, const char*>>& lines) {
+        if (lines.size() > h.entries - done) {
+            throw length_error("too many Matrix Market entries");
+        }
+        if (h.coordinate) {
+            ri.resize(done + lines.size());
+            ci.resize(done + lines.size());
+        }
+        v.resize(done + lines.size());
+        parallel_for(0, lines.size(), [&](size_t lo, size_t hi) {
+            for (size_t k = lo; k < hi; k++) {
+                const char* b = lines[k].first;
+                const char* e = lines[k].second;
+                size_t at = done + k;
+                if (h.coordinate) {
+                    size_t i = 0, j = 0;
+                    if (!parse_token(b, e, i) || !parse_token(b, e, j) || i == 0 || j == 0 || i > h.rows || j > h.cols) {
+                        throw invalid_argument("bad Matrix Market entry at line " + to_string(at + 1));
+                    }
+                    ri[at] = i - 1;
+                    ci[at] = j - 1;
+                }
+                if (h.pattern) {
+                    v[at] = T(1);
+                }
+                else if (!parse_token(b, e, v[at])) {
+                    throw invalid_argument("Matrix Market entry has no value");
+                }
+                T extra;
+                if (parse_token(b, e, extra)) {
+                    throw invalid_argument("extra values in Matrix Market entry");
+                }
+            }
+        }, 64);
+        done += lines.size();
+    });
+    if (done != h.entries) {
+        throw length_error("Matrix Market data is truncated");
+    }
+}
+
+// позиции значений массива: по столбцам, у симметричных - нижний треугольник
+template<typename F>
+void matrix_market_array_positions(const TMatrixMarketHeader& h, F f)
+{
+    size_t k = 0;
+    for (size_t j = 0; j < h.cols; j++) {
+        size_t i0 = h.symmetry == TSymmetry::general ? 0 : h.symmetry == TSymmetry::symmetric ? j : j + 1;
+        for (size_t i = i0; i < h.rows; i++) {
+            f(k++, i, j);
+        }
+    }
+}
+
+inline ifstream open_matrix_market(const string& path)
+{
+    ifstream f(path, ios::binary);
+    if (!f) {
+        throw runtime_error("cannot open file " + path);
+    }
+    return f;
+}
+
+template<typename T>
+TSparseMatrix<T> load_matrix_market_sparse(const string& path)
+{
+    ifstream f = open_matrix_market(path);
+    TMatrixMarketHeader h = read_matrix_market_header(f);
+    std::vector<size_t> ri, ci;
+    std::vector<T> v;
+    read_matrix_market_data(f, h, ri, ci, v);
+    if (!h.coordinate) {
+        std::vector<T> nz;
+        matrix_market_array_positions(h, [&](size_t k, size_t i, size_t j) {
+            if (v[k] != T()) {
+                ri.push_back(i);
+                ci.push_back(j);
+                nz.push_back(v[k]);
+            }
+        });
+        v.swap(nz);
+    }
+    return TSparseMatrix<T>(h.rows, h.cols, h.symmetry, std::move(ri), std::move(ci), std::move(v));
+}
+
+template<typename T>
+TDynamicMatrix<T> load_matrix_market_dense(const string& path)
+{
+    ifstream f = open_matrix_market(path);
+    TMatrixMarketHeader h = read_matrix_market_header(f);
+    if (h.rows != h.cols || h.rows > size_t(MAX_MATRIX_SIZE)) {
+        throw length_error("bad matrix size");
+    }
+    std::vector<size_t> ri, ci;
+    std::vector<T> v;
+    read_matrix_market_data(f, h, ri, ci, v);
+    if (h.coordinate) {
+        return TSparseMatrix<T>(h.rows, h.cols, h.symmetry, std::move(ri), std::move(ci), std::move(v)).to_dense();
+    }
+    TDynamicMatrix<T> res(h.rows);
+    matrix_market_array_positions(h, [&](size_t k, size_t i, size_t j) {
+        res[i][j] = v[k];
+        if (i != j && h.symmetry != TSymmetry::general) {
+            res[j][i] = h.symmetry == TSymmetry::skew ? -v[k] : v[k];
+        }
+    });
+    return res;
+}
+
+template<typename T>
+string matrix_market_field()
+{
+    return is_integral<T>::value ? "integer" : "real";
+}
+
+// плотная матрица - формат array general
+template<typename T>
+void save_matrix_market(const string& path, const TDynamicMatrix<T>& m)
+{
+    ofstream f(path, ios::binary);
+    if (!f) {
+        throw runtime_error("cannot create file " + path);
+    }
+    TTextWriter w(f);
+    w << "%%MatrixMarket matrix array " + matrix_market_field<T>() + " general\n";
+    w.number(m.size()) << ' ';
+    w.number(m.size()) << '\n';
+    for (size_t j = 0; j < m.size(); j++) {
+        for (size_t i = 0; i < m.size(); i++) {
+            w.number(m[i][j]) << '\n';
+        }
+    }
+    w.flush();
+}
+
+// разреженная - формат coordinate, у симметричных пишется хранимый треугольник
+template<typename T>
+void save_matrix_market(const string& path, const TSparseMatrix<T>& m)
+{
+    ofstream f(path, ios::binary);
+    if (!f) {
+        throw runtime_error("cannot create file " + path);
+    }
+    TTextWriter w(f);
+    const char* sym = m.symmetry() == TSymmetry::general ? " general\n"
+        : m.symmetry() == TSymmetry::symmetric ? " symmetric\n" : " skew-symmetric\n";
+    w << "%%MatrixMarket matrix coordinate " + matrix_market_field<T>() + sym;
+    w.number(m.rows()) << ' ';
+    w.number(m.cols()) << ' ';
+    w.number(m.nnz()) << '\n';
+    m.for_each_stored([&](size_t i, size_t j, const T& v) {
+        w.number(i + 1) << ' ';
+        w.number(j + 1) << ' ';
+        w.number(v) << '\n';
+    });
+    w.flush();
+}
+
+// Сжатый двоичный формат
+// Заголовок TBinaryHeader с layout = 3, reserved - число элементов в
+// блоке данных (у матрицы кратно порядку), с data_offset - таблица из
+// числа блоков + 1 смещений от начала файла, затем сами блоки. Блоки
+// кодируются и декодируются независимо и параллельно. Элементы блока по
+// строкам переводятся в 64-битные числа с сохранением порядка (у
+// вещественных - биты IEEE со знаком как у целых) и пишутся группами по
+// COMPRESS_GROUP. Для каждой группы выбирается самый короткий способ:
+// отступ от минимума группы, разность с предыдущим, вторая разность
+// (линейный прогноз) или XOR с предыдущим. Результат упаковывается
+// по битам минимальной ширины. Контрольная сумма - от исходных данных.
+const uint32_t COMPRESSED_LAYOUT = 3;
+const size_t COMPRESS_GROUP = 128;
+const size_t COMPRESS_BLOCK = size_t(1) << 16;
+
+enum TGroupCodec : unsigned char { codec_for, codec_delta, codec_delta2, codec_xor };
+
+template<typename T>
+uint64_t to_ordered(T x) noexcept
+{
+    if constexpr (is_floating_point<T>::value) {
+        typedef typename conditional<sizeof(T) == 4, uint32_t, uint64_t>::type U;
+        U b;
+        memcpy(&b, &x, sizeof(T));
+        const U sign = U(1) << (sizeof(T) * 8 - 1);
+        return uint64_t(b & sign ? ~b : b | sign);
+    }
+    else if constexpr (is_signed<T>::value) {
+        return uint64_t(int64_t(x)) ^ (uint64_t(1) << 63);
+    }
+    else {
+        return uint64_t(x);
+    }
+}
+
+template<typename T>
+T from_ordered(uint64_t u) noexcept
+{
+    if constexpr (is_floating_point<T>::value) {
+        typedef typename conditional<sizeof(T) == 4, uint32_t, uint64_t>::type U;
+        const U sign = U(1) << (sizeof(T) * 8 - 1);
+        U b = U(u);
+        b = b & sign ? b & ~sign : ~b;
+        T x;
+        memcpy(&x, &b, sizeof(T));
+        return x;
+    }
+    else if constexpr (is_signed<T>::value) {
+        return T(int64_t(u ^ (uint64_t(1) << 63)));
+    }
+    else {
+        return T(u);
+    }
+}
+
+inline uint64_t zigzag(uint64_t d) noexcept { return (d << 1) ^ uint64_t(int64_t(d) >> 63); }
+inline uint64_t unzigzag(uint64_t z) noexcept { return (z >> 1) ^ (uint64_t(0) - (z & 1)); }
+
+inline unsigned bit_width64(uint64_t x) noexcept
+{
+    unsigned w = 0;
+    while (x) {
+        x >>= 1;
+        w++;
+    }
+    return w;
+}
+
+inline uint64_t load_le64(const unsigned char* p) noexcept
+{
+    uint64_t v = 0;
+    for (int k = 7; k >= 0; k--) {
+        v = (v << 8) | p[k];
+    }
+    return v;
+}
+
+inline void store_le64(unsigned char* p, uint64_t v) noexcept
+{
+    for (int k = 0; k < 8; k++) {
+        p[k] = (unsigned char)(v >> (8 * k));
+    }
+}
+
+// группа из cnt чисел: байт способа, байт ширины, [минимум], слова битов
+inline void encode_group(const uint64_t* u, size_t cnt, uint64_t& p1, uint64_t& p2, std::vector<unsigned char>& out)
+{
+    uint64_t res[4][COMPRESS_GROUP];
+    uint64_t lo = *std::min_element(u, u + cnt);
+    uint64_t a = p1, b = p2;
+    for (size_t i = 0; i < cnt; i++) {
+        res[codec_for][i] = u[i] - lo;
+        res[codec_delta][i] = zigzag(u[i] - a);
+        res[codec_delta2][i] = zigzag(u[i] - (2 * a - b));
+        res[codec_xor][i] = u[i] ^ a;
+        b = a;
+        a = u[i];
+    }
+    unsigned best = 0, width = 65;
+    for (unsigned c = 0; c < 4; c++) {
+        uint64_t acc = 0;
+        for (size_t i = 0; i < cnt; i++) {
+            acc |= res[c][i];
+        }
+        // отступ от минимума требует еще 8 байт
+        unsigned w = bit_width64(acc);
+        if (w * cnt + (c == codec_for ? 64 : 0) < width * cnt + (best == codec_for ? 64 : 0) || width == 65) {
+            best = c;
+            width = w;
+        }
+    }
+    size_t words = (cnt * width + 63) / 64;
+    size_t pos = out.size();
+    out.resize(pos + 2 + (best == codec_for ? 8 : 0) + words * 8, 0);
+    out[pos] = (unsigned char)best;
+    out[pos + 1] = (unsigned char)width;
+    pos += 2;
+    if (best == codec_for) {
+        store_le64(&out[pos], lo);
+        pos += 8;
+    }
+    if (width) {
+        std::vector<uint64_t> bits(words, 0);
+        for (size_t i = 0; i < cnt; i++) {
+            size_t bp = i * width, wi = bp >> 6, sh = bp & 63;
+            bits[wi] |= res[best][i] << sh;
+            if (sh + width > 64) {
+                bits[wi + 1] |= res[best][i] >> (64 - sh);
+            }
+        }
+        for (size_t k = 0; k < words; k++) {
+            store_le64(&out[pos + 8 * k], bits[k]);
+        }
+    }
+    p1 = a;
+    p2 = b;
+}
+
+// обратное к encode_group, возвращает позицию после группы
+inline const unsigned char* decode_group(const unsigned char* p, const unsigned char* end, size_t cnt,
+    uint64_t& p1, uint64_t& p2, uint64_t* u)
+{
+    if (end - p < 2 || p[0] > codec_xor || p[1] > 64) {
+        throw invalid_argument("bad compressed group");
+    }
+    unsigned c = p[0], width = p[1];
+    p += 2;
+    uint64_t lo = 0;
+    if (c == codec_for) {
+        if (end - p < 8) {
+            throw invalid_argument("bad compressed group");
+        }
+        lo = load_le64(p);
+        p += 8;
+    }
+    size_t words = (cnt * width + 63) / 64;
+    if (size_t(end - p) < words * 8) {
+        throw invalid_argument("compressed block is truncated");
+    }
+    const uint64_t mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+    uint64_t a = p1, b = p2;
+    for (size_t i = 0; i < cnt; i++) {
+        uint64_t r = 0;
+        if (width) {
+            size_t bp = i * width, wi = bp >> 6, sh = bp & 63;
+            r = load_le64(p + 8 * wi) >> sh;
+            if (sh + width > 64) {
+                r |= load_le64(p + 8 * wi + 8) << (64 - sh);
+            }
+            r &= mask;
+        }
+        uint64_t x = c == codec_for ? lo + r : c == codec_delta ? a + unzigzag(r)
+            : c == codec_delta2 ? 2 * a - b + unzigzag(r) : a ^ r;
+        u[i] = x;
+        b = a;
+        a = x;
+    }
+    p1 = a;
+    p2 = b;
+    return p + words * 8;
+}
+
+template<typename T>
+std::vector<unsigned char> encode_block(const T* x, size_t cnt)
+{
+    std::vector<unsigned char> out;
+    uint64_t u[COMPRESS_GROUP], p1 = 0, p2 = 0;
+    for (size_t g = 0; g < cnt; g += COMPRESS_GROUP) {
+        size_t c = min(COMPRESS_GROUP, cnt - g);
+        for (size_t i = 0; i < c; i++) {
+            u[i] = to_ordered(x[g + i]);
+        }
+        encode_group(u, c, p1, p2, out);
+    }
+    return out;
+}
+
+template<typename T>
+void decode_block(const unsigned char* p, const unsigned char* end, T* x, size_t cnt)
+{
+    uint64_t u[COMPRESS_GROUP], p1 = 0, p2 = 0;
+    for (size_t g = 0; g < cnt; g += COMPRESS_GROUP) {
+        size_t c = min(COMPRESS_GROUP, cnt - g);
+        p = decode_group(p, end, c, p1, p2, u);
+        for (size_t i = 0; i < c; i++) {
+            x[g + i] = from_ordered<T>(u[i]);
+        }
+    }
+}
+
+// block(i, buf) дает память i-го блока данных (buf - место для сборки)
+template<typename T, typename F>
+void write_compressed(const string& path, TBinaryHeader h, size_t total, size_t per_block, F block)
+{
+    size_t blocks = (total + per_block - 1) / per_block;
+    std::vector<std::vector<unsigned char>> enc(blocks);
+    parallel_for(0, blocks, [&](size_t lo, size_t hi) {
+        std::vector<T> buf(per_block);
+        for (size_t i = lo; i < hi; i++) {
+            enc[i] = encode_block(block(i, buf.data()), min(per_block, total - i * per_block));
+        }
+    }, per_block * 16);
+    h.layout = COMPRESSED_LAYOUT;
+    h.reserved = per_block;
+    std::vector<uint64_t> table(blocks + 1);
+    table[0] = h.data_offset + table.size() * sizeof(uint64_t);
+    for (size_t i = 0; i < blocks; i++) {
+        table[i + 1] = table[i] + enc[i].size();
+    }
+    ofstream f(path, ios::binary);
+    if (!f || !f.write(reinterpret_cast<const char*>(&h), sizeof(h))
+        || !f.write(reinterpret_cast<const char*>(table.data()), streamsize(table.size() * sizeof(uint64_t)))) {
+        throw runtime_error("cannot write file " + path);
+    }
+    for (auto& e : enc) {
+        if (!f.write(reinterpret_cast<const char*>(e.data()), streamsize(e.size()))) {
+            throw runtime_error("cannot write file " + path);
+        }
+    }
+}
+
+template<typename T>
+void save_matrix_compressed(const string& path, const TDynamicMatrix<T>& m)
+{
+    size_t n = m.size(), rows = max<size_t>(1, COMPRESS_BLOCK / n);
+    TBinaryHeader h = make_binary_header<T>(n, n);
+    h.checksum = data_checksum(m);
+    write_compressed<T>(path, h, n * n, rows * n, [&](size_t i, T* buf) {
+        for (size_t r = i * rows; r < min(n, (i + 1) * rows); r++) {
+            std::copy(m[r].data(), m[r].data() + n, buf + (r - i * rows) * n);
+        }
+        return static_cast<const T*>(buf);
+    });
+}
+
+template<typename T>
+void save_vector_compressed(const string& path, const TDynamicVector<T>& v)
+{
+    TBinaryHeader h = make_binary_header<T>(v.size(), 0);
+    h.checksum = data_checksum(reinterpret_cast<const unsigned char*>(v.data()), v.size(), 0, sizeof(T));
+    write_compressed<T>(path, h, v.size(), COMPRESS_BLOCK,
+        [&](size_t i, T*) { return v.data() + i * COMPRESS_BLOCK; });
+}
+
+// отображенный сжатый файл с проверенными заголовком и таблицей блоков
+struct TCompressedFile
+{
+    shared_ptr<void> file;
+    TBinaryHeader h;
+    std::vector<uint64_t> table;
+    size_t total = 0;
+    size_t per_block = 0;
+};
+
+template<typename T>
+TCompressedFile open_compressed(const string& path, bool matrix)
+{
+    TCompressedFile c;
+    size_t len = 0;
+    c.file = map_file(path, len);
+    TBinaryHeader& h = c.h;
+    memcpy(&h, c.file.get(), min(len, sizeof(h)));
+    if (len < sizeof(h) || memcmp(h.magic, BINARY_MAGIC, sizeof(h.magic)) != 0) {
+        throw invalid_argument("not a tmatrix binary file");
+    }
+    if (h.endian != BINARY_ENDIAN_TAG || h.version != BINARY_VERSION || h.dtype != dtype_code<T>()
+        || h.layout != COMPRESSED_LAYOUT || h.reserved == 0 || h.data_offset < sizeof(h)) {
+        throw invalid_argument("not a compressed file of this type");
+    }
+    if ((matrix ? h.cols != h.rows : h.cols != 0) || h.rows == 0
+        || h.rows > uint64_t(matrix ? MAX_MATRIX_SIZE : MAX_VECTOR_SIZE)
+        || (matrix && h.reserved % h.rows != 0)) {
+        throw length_error(matrix ? "bad matrix size" : "bad vector size");
+    }
+    c.total = size_t(h.rows) * (matrix ? size_t(h.rows) : 1);
+    // блок больше всех данных равносилен одному блоку: буфер декодера не
+    // должен зависеть от значения из файла
+    c.per_block = size_t(min<uint64_t>(h.reserved, c.total));
+    size_t blocks = (c.total + c.per_block - 1) / c.per_block;
+    if (h.data_offset > len || (blocks + 1) * sizeof(uint64_t) > len - h.data_offset) {
+        throw length_error("bad binary file size");
+    }
+    c.table.resize(blocks + 1);
+    memcpy(c.table.data(), static_cast<const char*>(c.file.get()) + h.data_offset, c.table.size() * sizeof(uint64_t));
+    for (size_t i = 0; i < blocks; i++) {
+        if (c.table[i] > c.table[i + 1] || c.table[i + 1] > len) {
+            throw invalid_argument("bad compressed block table");
+        }
+    }
+    return c;
+}
+
+// блоки декодируются параллельно; block(i, buf) - память для i-го блока,
+// done(i, buf) вызывается после декодирования
+template<typename T, typename F, typename G>
+void decode_compressed(const TCompressedFile& c, F block, G done)
+{
+    const unsigned char* base = static_cast<const unsigned char*>(c.file.get());
+    parallel_for(0, c.table.size() - 1, [&](size_t lo, size_t hi) {
+        std::vector<T> buf(c.per_block);
+        for (size_t i = lo; i < hi; i++) {
+            T* x = block(i, buf.data());
+            decode_block(base + c.table[i], base + c.table[i + 1], x, min(c.per_block, c.total - i * c.per_block));
+            done(i, x);
+        }
+    }, c.per_block * 8);
+}
+
+template<typename T>
+TDynamicMatrix<T> load_matrix_compressed(const string& path, bool verify = false)
+{
+    TCompressedFile c = open_compressed<T>(path, true);
+    size_t n = size_t(c.h.rows), rows = c.per_block / n;
+    TDynamicMatrix<T> res(n);
+    decode_compressed<T>(c, [](size_t, T* buf) { return buf; }, [&](size_t i, const T* x) {
+        for (size_t r = i * rows; r < min(n, (i + 1) * rows); r++) {
+            std::copy(x + (r - i * rows) * n, x + (r - i * rows + 1) * n, res[r].data());
+        }
+    });
+    if (verify && data_checksum(res) != c.h.checksum) {
+        throw runtime_error("binary data checksum mismatch");
+    }
+    return res;
+}
+
+template<typename T>
+TDynamicVector<T> load_vector_compressed(const string& path, bool verify = false)
+{
+    TCompressedFile c = open_compressed<T>(path, false);
+    TDynamicVector<T> res(c.total);
+    decode_compressed<T>(c, [&](size_t i, T*) { return res.data() + i * c.per_block; }, [](size_t, const T*) {});
+    if (verify) {
+        verify_binary_data(c.h, res.data(), sizeof(T));
+    }
+    return res;
+}
+
+// Матрица во внешней памяти
+// Файл двоичного формата с layout = 2: матрица порядка n делится на плитки
+// tile x tile, плитка (I, J) хранится непрерывно по строкам со смещения
+// data_offset + (I * tiles + J) * tile * tile элементов, краевые плитки
+// дополнены нулями. Порядок n не ограничен MAX_MATRIX_SIZE, в памяти
+// находятся только загруженные плитки. Контрольная сумма не ведется.
+const uint32_t TILED_LAYOUT = 2;
+
+template<typename T>
+class TTiledMatrix
+{
+    string path;
+    size_t n = 0, b = 0, nt = 0;
+    uint64_t offset = sizeof(TBinaryHeader);
+    bool writable = true;
+    mutable fstream f;
+    mutable mutex io;
+
+    uint64_t tile_pos(size_t I, size_t J) const
+    {
+        if (I >= nt || J >= nt) {
+            throw out_of_range("tile index is out of range");
+        }
+        return offset + (uint64_t(I) * nt + J) * b * b * sizeof(T);
+    }
+    void check_writable() const
+    {
+        if (!writable) {
+            throw logic_error("tiled matrix is opened read-only");
+        }
+    }
+public:
+    // новый файл из нулей
+    TTiledMatrix(const string& file, size_t size, size_t tile) : path(file), n(size), b(tile)
+    {
+        if (n == 0 || b == 0 || b > MAX_MATRIX_SIZE) {
+            throw length_error("bad tiled matrix size");
+        }
+        nt = (n + b - 1) / b;
+        TBinaryHeader h = make_binary_header<T>(n, n);
+        h.layout = TILED_LAYOUT;
+        h.reserved = b;
+        {
+            ofstream out(path, ios::binary | ios::trunc);
+            if (!out.write(reinterpret_cast<const char*>(&h), sizeof(h))) {
+                throw runtime_error("cannot create file " + path);
+            }
+            out.seekp(streamoff(tile_pos(nt - 1, nt - 1) + b * b * sizeof(T) - 1));
+            if (!out.put(0)) {
+                throw runtime_error("cannot create file " + path);
+            }
+        }
+        f.open(path, ios::in | ios::out | ios::binary);
+        if (!f.is_open()) {
+            throw runtime_error("cannot open file " + path);
+        }
+    }
+    // существующий файл; writable = false - только чтение
+    explicit TTiledMatrix(const string& file, bool write = true) : path(file), writable(write)
+    {
+        f.open(path, write ? ios::in | ios::out | ios::binary : ios::in | ios::binary);
+        TBinaryHeader h;
+        if (!f || !f.read(reinterpret_cast<char*>(&h), sizeof(h))
+            || memcmp(h.magic, BINARY_MAGIC, sizeof(h.magic)) != 0) {
+            throw invalid_argument("not a tmatrix binary file");
+        }
+        if (h.endian != BINARY_ENDIAN_TAG || h.version != BINARY_VERSION || h.dtype != dtype_code<T>()
+            || h.layout != TILED_LAYOUT || h.rows != h.cols || h.rows == 0 || h.reserved == 0
+            || h.reserved > MAX_MATRIX_SIZE || h.data_offset < sizeof(TBinaryHeader)) {
+            throw invalid_argument("not a tiled matrix of this type");
+        }
+        n = size_t(h.rows);
+        b = size_t(h.reserved);
+        nt = (n + b - 1) / b;
+        offset = h.data_offset;
+        f.seekg(0, ios::end);
+        if (uint64_t(f.tellg()) < tile_pos(nt - 1, nt - 1) + b * b * sizeof(T)) {
+            throw length_error("bad binary file size");
+        }
+    }
+    TTiledMatrix(const TTiledMatrix&) = delete;
+    TTiledMatrix& operator=(const TTiledMatrix&) = delete;
+
+    bool is_writable() const noexcept { return writable; }
+    size_t size() const noexcept { return n; }
+    size_t tile_size() const noexcept { return b; }
+    // число плиток по одной стороне
+    size_t tiles() const noexcept { return nt; }
+    const string& file() const noexcept { return path; }
+
+    // плитка в непрерывной памяти, строки - представления над ней
+    TDynamicMatrix<T> make_tile() const
+    {
+        shared_ptr<T> mem(new T[b * b](), default_delete<T[]>());
+        return TDynamicMatrix<T>(mem.get(), b, mem);
+    }
+    void read_tile(size_t I, size_t J, TDynamicMatrix<T>& t) const
+    {
+        if (t.size() != b) {
+            throw length_error("bad tile size");
+        }
+        uint64_t pos = tile_pos(I, J);
+        lock_guard<mutex> lock(io);
+        f.seekg(streamoff(pos));
+        for (size_t i = 0; i < b; i++) {
+            if (!f.read(reinterpret_cast<char*>(t[i].data()), streamsize(b * sizeof(T)))) {
+                throw runtime_error("cannot read tile from " + path);
+            }
+        }
+    }
+    void write_tile(size_t I, size_t J, const TDynamicMatrix<T>& t)
+    {
+        check_writable();
+        if (t.size() != b) {
+            throw length_error("bad tile size");
+        }
+        uint64_t pos = tile_pos(I, J);
+        lock_guard<mutex> lock(io);
+        f.seekp(streamoff(pos));
+        for (size_t i = 0; i < b; i++) {
+            if (!f.write(reinterpret_cast<const char*>(t[i].data()), streamsize(b * sizeof(T)))) {
+                throw runtime_error("cannot write tile to " + path);
+            }
+        }
+        f.flush();
+    }
+
+    T get(size_t i, size_t j) const
+    {
+        if (i >= n || j >= n) {
+            throw out_of_range("tiled matrix index is out of range");
+        }
+        T x;
+        lock_guard<mutex> lock(io);
+        f.seekg(streamoff(tile_pos(i / b, j / b) + ((i % b) * b + j % b) * sizeof(T)));
+        if (!f.read(reinterpret_cast<char*>(&x), sizeof(T))) {
+            throw runtime_error("cannot read " + path);
+        }
+        return x;
+    }
+    void set(size_t i, size_t j, const T& x)
+    {
+        check_writable();
+        if (i >= n || j >= n) {
+            throw out_of_range("tiled matrix index is out of range");
+        }
+        lock_guard<mutex> lock(io);
+        f.seekp(streamoff(tile_pos(i / b, j / b) + ((i % b) * b + j % b) * sizeof(T)));
+        if (!f.write(reinterpret_cast<const char*>(&x), sizeof(T)) || !f.flush()) {
+            throw runtime_error("cannot write " + path);
+        }
+    }
+
+    // обмен с плотной матрицей того же порядка
+    void assign(const TDynamicMatrix<T>& m)
+    {
+        if (m.size() != n) {
+            throw length_error("different matrix sizes");
+        }
+        TDynamicMatrix<T> t = make_tile();
+        for (size_t I = 0; I < nt; I++) {
+            for (size_t J = 0; J < nt; J++) {
+                for (size_t i = 0; i < b; i++) {
+                    for (size_t j = 0; j < b; j++) {
+                        size_t r = I * b + i, c = J * b + j;
+                        t[i][j] = r < n && c < n ? m[r][c] : T();
+                    }
+                }
+                write_tile(I, J, t);
+            }
+        }
+    }
+    TDynamicMatrix<T> to_dense() const
+    {
+        TDynamicMatrix<T> res(n);
+        TDynamicMatrix<T> t = make_tile();
+        for (size_t I = 0; I < nt; I++) {
+            for (size_t J = 0; J < nt; J++) {
+                read_tile(I, J, t);
+                for (size_t i = 0; i < b && I * b + i < n; i++) {
+                    for (size_t j = 0; j < b && J * b + j < n; j++) {
+                        res[I * b + i][J * b + j] = t[i][j];
+                    }
+                }
+            }
+        }
+        return res;
+    }
+};
+
+// счетчики обменов с диском
+struct TOutOfCoreStats
+{
+    size_t tile_reads = 0;
+    size_t tile_writes = 0;
+};
+
+// C = A * B во внешней памяти. Плитки C считаются по строкам плиток:
+// для C(I, J) по K накапливаются произведения A(I, K) * B(K, J) ядром
+// gemm_update. Пока считается шаг, следующая пара плиток читается в фоне,
+// готовая плитка C пишется в фоне (двойная буферизация). budget - предел
+// памяти под плитки в байтах: нужно не меньше 6 плиток (две пары на чтение,
+// накопитель и плитка на запись); при запасе еще на tiles() плиток строка
+// плиток A(I, *) держится в памяти и читается один раз.
+template<typename T>
+TOutOfCoreStats gemm_out_of_core(TTiledMatrix<T>& C, const TTiledMatrix<T>& A, const TTiledMatrix<T>& B,
+    size_t budget)
+{
+    size_t n = A.size(), b = A.tile_size(), nt = A.tiles();
+    if (B.size() != n || C.size() != n || B.tile_size() != b || C.tile_size() != b) {
+        throw length_error("different matrix sizes");
+    }
+    if (&C == &A || &C == &B || C.file() == A.file() || C.file() == B.file()) {
+        throw invalid_argument("result matrix should not alias an operand");
+    }
+    if (!C.is_writable()) {
+        throw logic_error("result matrix is opened read-only");
+    }
+    size_t tile_bytes = b * b * sizeof(T);
+    if (budget / tile_bytes < 6) {
+        throw invalid_argument("memory budget is smaller than six tiles");
+    }
+    bool keep_panel = budget / tile_bytes >= 6 + nt;
+
+    TOutOfCoreStats st;
+    std::vector<shared_ptr<TDynamicMatrix<T>>> panel;
+    size_t panel_row = nt;
+    struct TStep { shared_ptr<TDynamicMatrix<T>> a, b; };
+    auto read = [&st](const TTiledMatrix<T>& M, size_t I, size_t J) {
+        auto t = make_shared<TDynamicMatrix<T>>(M.make_tile());
+        M.read_tile(I, J, *t);
+        st.tile_reads++;
+        return t;
+    };
+    // загрузка пары плиток шага s = (I * nt + J) * nt + K; загрузки идут
+    // строго по одной, поэтому panel и st меняются без блокировок
+    auto load = [&](size_t s) {
+        size_t I = s / (nt * nt), J = s / nt % nt, K = s % nt;
+        TStep step;
+        if (keep_panel) {
+            if (panel_row != I) {
+                panel.clear();
+                panel_row = I;
+            }
+            if (panel.size() == K) {
+                panel.push_back(read(A, I, K));
+            }
+            step.a = panel[K];
+        }
+        else {
+            step.a = read(A, I, K);
+        }
+        step.b = read(B, K, J);
+        return step;
+    };
+
+    size_t steps = nt * nt * nt;
+    // накопитель и плитка на запись меняются ролями
+    TDynamicMatrix<T> acc_tile = C.make_tile(), out_tile = C.make_tile();
+    TDynamicMatrix<T>* acc = &acc_tile;
+    TDynamicMatrix<T>* out = &out_tile;
+    future<void> written;
+    future<TStep> next = async(launch::async, load, size_t(0));
+    for (size_t s = 0; s < steps; s++) {
+        TStep cur = next.get();
+        if (s + 1 < steps) {
+            next = async(launch::async, load, s + 1);
+        }
+        if (s % nt == 0) {
+            for (size_t i = 0; i < b; i++) {
+                std::fill((*acc)[i].data(), (*acc)[i].data() + b, T());
+            }
+        }
+        gemm_update(*acc, *cur.a, *cur.b, 0, b, 0, b, 0, b);
+        if (s % nt == nt - 1) {
+            if (written.valid()) {
+                written.get();
+            }
+            std::swap(acc, out);
+            size_t I = s / (nt * nt), J = s / nt % nt;
+            written = async(launch::async, [&C, out, I, J]() { C.write_tile(I, J, *out); });
+            st.tile_writes++;
+        }
+    }
+    written.get();
+    return st;
+}
+
+// Матрица над отображенным файлом
+// Память строк - общее отображение (MAP_SHARED) файла двоичного формата:
+// изменения попадают в файл через кэш страниц, несколько процессов, открывших
+// один файл, видят одну копию данных. matrix() - обычная TDynamicMatrix,
+// все операции над ней работают без изменений; присваивание результата
+// (m = m * a) записывает элементы в файл. sync() пересчитывает контрольную
+// сумму в заголовке и сбрасывает страницы на диск. Только для POSIX.
+enum class TAccessHint { normal, sequential, random, willneed };
+
+template<typename T>
+class TMappedMatrix
+{
+    shared_ptr<void> map;
+    size_t len = 0;
+    bool writable = true;
+    TDynamicMatrix<T> m;
+
+    TBinaryHeader* header() const noexcept { return static_cast<TBinaryHeader*>(map.get()); }
+    void attach(const string& path)
+    {
+        map = map_file(path, len, true, writable);
+        TBinaryHeader h;
+        memcpy(&h, map.get(), min(len, sizeof(h)));
+        if (check_binary_header<T>(h, len, true) || h.layout != 0) {
+            throw invalid_argument("file should be row-major with native byte order");
+        }
+        T* data = reinterpret_cast<T*>(static_cast<char*>(map.get()) + h.data_offset);
+        m = TDynamicMatrix<T>(data, size_t(h.rows), map);
+    }
+public:
+    // новый файл из нулевой матрицы порядка n
+    static TMappedMatrix create(const string& path, size_t n, TAccessHint hint = TAccessHint::normal)
+    {
+        if (n == 0 || n > MAX_MATRIX_SIZE) {
+            throw length_error("bad matrix size");
+        }
+        TBinaryHeader h = make_binary_header<T>(n, n);
+        TDynamicVector<T> zero(n);
+        std::vector<uint64_t> parts(n, hash_bytes(zero.data(), n * sizeof(T)));
+        h.checksum = fold_hashes(parts);
+        {
+            ofstream f(path, ios::binary | ios::trunc);
+            if (!f.write(reinterpret_cast<const char*>(&h), sizeof(h))) {
+                throw runtime_error("cannot create file " + path);
+            }
+            f.seekp(streamoff(sizeof(h) + n * n * sizeof(T) - 1));
+            if (!f.put(0)) {
+                throw runtime_error("cannot create file " + path);
+            }
+        }
+        return TMappedMatrix(path, true, hint);
+    }
+    // существующий файл; writable = false - отображение только для чтения
+    explicit TMappedMatrix(const string& path, bool write = true, TAccessHint hint = TAccessHint::normal)
+        : writable(write)
+    {
+        attach(path);
+        advise(hint);
+    }
+    TMappedMatrix(const TMappedMatrix&) = delete;
+    TMappedMatrix& operator=(const TMappedMatrix&) = delete;
+    // перемещение передает отображение, исходный объект остается пустым
+    TMappedMatrix(TMappedMatrix&& f) noexcept
+        : map(std::move(f.map)), len(f.len), writable(f.writable), m(std::move(f.m))
+    {
+        f.len = 0;
+    }
+    TMappedMatrix& operator=(TMappedMatrix&& f) noexcept
+    {
+        TMappedMatrix tmp(std::move(f));
+        map.swap(tmp.map);
+        std::swap(len, tmp.len);
+        std::swap(writable, tmp.writable);
+        swap(m, tmp.m);
+        return *this;
+    }
+
+    bool is_writable() const noexcept { return writable; }
+    TDynamicMatrix<T>& matrix()
+    {
+        if (!writable) {
+            throw logic_error("matrix is mapped read-only");
+        }
+        return m;
+    }
+    const TDynamicMatrix<T>& view() const noexcept { return m; }
+
+    // подсказка ядру о порядке обращения к страницам
+    void advise(TAccessHint hint)
+    {
+#ifndef _WIN32
+        int adv = hint == TAccessHint::sequential ? MADV_SEQUENTIAL : hint == TAccessHint::random ? MADV_RANDOM
+            : hint == TAccessHint::willneed ? MADV_WILLNEED : MADV_NORMAL;
+        madvise(map.get(), len, adv);
+#endif
+    }
+    void sync()
+    {
+        if (!writable) {
+            return;
+        }
+        header()->checksum = data_checksum(m);
+#ifndef _WIN32
+        if (msync(map.get(), len, MS_SYNC) != 0) {
+            throw runtime_error("cannot sync mapped matrix");
+        }
+#endif
+    }
+};
+
+// Матрица в разделяемой памяти
+// Именованный сегмент POSIX (shm_open): страница заголовка TSharedHeader и
+// данные по строкам со следующей страницы. Производитель создает сегмент и
+// пишет в matrix(), потребители присоединяются по имени и получают
+// представление только для чтения (данные отображаются с PROT_READ) без
+// копирования. Заголовок неблокирующий: поля - атомарные 64-битные
+// счетчики. generation увеличивается вызовом publish() после записи новых
+// данных; refs - число присоединенных объектов, последний отсоединившийся
+// удаляет имя сегмента. Процесс, завершившийся аварийно, счетчик не
+// уменьшает. Только для POSIX.
+const char SHARED_MAGIC[8] = { 'T', 'M', 'A', 'T', 'S', 'H', 'M', 0 };
+
+struct TSharedHeader
+{
+    char magic[8];
+    uint32_t dtype;
+    uint32_t reserved;
+    atomic<uint64_t> rows;
+    atomic<uint64_t> generation;
+    atomic<uint64_t> refs;
+};
+static_assert(atomic<uint64_t>::is_always_lock_free, "shared header requires lock-free 64-bit atomics");
+
+template<typename T>
+class TSharedMatrix
+{
+    string name;
+    size_t page = 0, bytes = 0;
+    shared_ptr<void> head_map, data_map;
+    TSharedHeader* head = nullptr;
+    bool owner = false;
+    TDynamicMatrix<T> m;
+
+    static string segment_name(const string& s)
+    {
+        return s.empty() || s[0] != '/' ? "/" + s : s;
+    }
+#ifndef _WIN32
+    static shared_ptr<void> map_part(int fd, size_t len, size_t off, int prot)
+    {
+        void* addr = mmap(nullptr, len, prot, MAP_SHARED, fd, off_t(off));
+        if (addr == MAP_FAILED) {
+            return nullptr;
+        }
+        return shared_ptr<void>(addr, [len](void* p) { munmap(p, len); });
+    }
+#endif
+    TSharedMatrix(const string& segment, size_t n, bool create) : name(segment_name(segment)), owner(create)
+    {
+#ifndef _WIN32
+        page = size_t(sysconf(_SC_PAGESIZE));
+        int fd = shm_open(name.c_str(), create ? O_CREAT | O_EXCL | O_RDWR : O_RDWR, 0600);
+        if (fd < 0) {
+            throw runtime_error("cannot open shared segment " + name);
+        }
+        struct stat st;
+        if (create) {
+            bytes = n * n * sizeof(T);
+            if (ftruncate(fd, off_t(page + bytes)) != 0) {
+                ::close(fd);
+                shm_unlink(name.c_str());
+                throw runtime_error("cannot allocate shared segment " + name);
+            }
+        }
+        else if (fstat(fd, &st) != 0 || size_t(st.st_size) < page) {
+            ::close(fd);
+            throw invalid_argument("not a shared matrix segment " + name);
+        }
+        head_map = map_part(fd, page, 0, PROT_READ | PROT_WRITE);
+        if (!head_map) {
+            ::close(fd);
+            if (create) {
+                shm_unlink(name.c_str());
+            }
+            throw runtime_error("cannot map shared segment " + name);
+        }
+        head = static_cast<TSharedHeader*>(head_map.get());
+        if (create) {
+            head = new (head) TSharedHeader();
+            memcpy(head->magic, SHARED_MAGIC, sizeof(head->magic));
+            head->dtype = dtype_code<T>();
+            head->rows.store(n, memory_order_relaxed);
+            head->generation.store(0, memory_order_relaxed);
+            head->refs.store(1, memory_order_release);
+        }
+        else {
+            if (memcmp(head->magic, SHARED_MAGIC, sizeof(head->magic)) != 0 || head->dtype != dtype_code<T>()) {
+                ::close(fd);
+                throw invalid_argument("not a shared matrix of this type " + name);
+            }
+            // присоединение только к живому сегменту
+            uint64_t r = head->refs.load(memory_order_acquire);
+            do {
+                if (r == 0) {
+                    ::close(fd);
+                    throw runtime_error("shared segment is being destroyed " + name);
+                }
+            } while (!head->refs.compare_exchange_weak(r, r + 1, memory_order_acq_rel));
+            n = size_t(head->rows.load(memory_order_acquire));
+            bytes = n * n * sizeof(T);
+            if (n == 0 || n > MAX_MATRIX_SIZE || size_t(st.st_size) < page + bytes) {
+                release();
+                ::close(fd);
+                throw invalid_argument("bad shared matrix size " + name);
+            }
+        }
+        data_map = map_part(fd, bytes, page, create ? PROT_READ | PROT_WRITE : PROT_READ);
+        ::close(fd);
+        if (!data_map) {
+            release();
+            throw runtime_error("cannot map shared segment " + name);
+        }
+        m = TDynamicMatrix<T>(static_cast<T*>(data_map.get()), n, data_map);
+#else
+        (void)n;
+        (void)create;
+        throw runtime_error("shared memory matrices are not supported on this platform");
+#endif
+    }
+    void release() noexcept
+    {
+#ifndef _WIN32
+        if (head && head->refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+            shm_unlink(name.c_str());
+        }
+        head = nullptr;
+#endif
+    }
+public:
+    // производитель: новый сегмент с нулевой матрицей порядка n
+    static TSharedMatrix create(const string& segment, size_t n)
+    {
+        if (n == 0 || n > MAX_MATRIX_SIZE) {
+            throw length_error("bad matrix size");
+        }
+        return TSharedMatrix(segment, n, true);
+    }
+    // потребитель: представление существующего сегмента только для чтения
+    static TSharedMatrix attach(const string& segment)
+    {
+        return TSharedMatrix(segment, 0, false);
+    }
+    TSharedMatrix(const TSharedMatrix&) = delete;
+    TSharedMatrix& operator=(const TSharedMatrix&) = delete;
+    // перемещение передает присоединение: у исходного объекта head
+    // обнуляется, и счетчик refs уменьшается только один раз
+    TSharedMatrix(TSharedMatrix&& s) noexcept
+        : name(std::move(s.name)), page(s.page), bytes(s.bytes), head_map(std::move(s.head_map)),
+        data_map(std::move(s.data_map)), head(s.head), owner(s.owner), m(std::move(s.m))
+    {
+        s.head = nullptr;
+        s.owner = false;
+    }
+    TSharedMatrix& operator=(TSharedMatrix&& s) noexcept
+    {
+        TSharedMatrix tmp(std::move(s));
+        name.swap(tmp.name);
+        std::swap(page, tmp.page);
+        std::swap(bytes, tmp.bytes);
+        head_map.swap(tmp.head_map);
+        data_map.swap(tmp.data_map);
+        std::swap(head, tmp.head);
+        std::swap(owner, tmp.owner);
+        swap(m, tmp.m);
+        return *this;
+    }
+    ~TSharedMatrix()
+    {
+        release();
+    }
+
+    const string& segment() const noexcept { return name; }
+    bool is_owner() const noexcept { return owner; }
+    size_t size() const noexcept { return m.size(); }
+    uint64_t generation() const noexcept { return head->generation.load(memory_order_acquire); }
+    uint64_t refs() const noexcept { return head->refs.load(memory_order_acquire); }
+
+    TDynamicMatrix<T>& matrix()
+    {
+        if (!owner) {
+            throw logic_error("shared matrix is attached read-only");
+        }
+        return m;
+    }
+    const TDynamicMatrix<T>& view() const noexcept { return m; }
+
+    // данные записаны: новое поколение видно потребителям вместе с ними
+    uint64_t publish()
+    {
+        if (!owner) {
+            throw logic_error("shared matrix is attached read-only");
+        }
+        return head->generation.fetch_add(1, memory_order_acq_rel) + 1;
+    }
+};
+
+// Конвейер пакетной обработки
+// Три стадии: чтение задания i + 1, счет задания i и запись результата
+// i - 1 идут одновременно, стадии связаны очередями из depth элементов
+// (depth = 2 - двойная буферизация). Чтение и запись идут в отдельных
+// потоках, счет - в вызывающем потоке, отдельного пула для него нет:
+// задания считаются по одному, а каждое распараллеливается внутри через
+// parallel_for. Для
+// каждой стадии считается время работы и ожидания на очередях: стадия с
+// наибольшим временем работы ограничивает пропускную способность.
+template<typename T>
+class TBoundedQueue
+{
+    std::deque<T> q;
+    size_t cap;
+    bool closed = false;
+    mutex mx;
+    condition_variable not_empty, not_full;
+public:
+    explicit TBoundedQueue(size_t capacity) : cap(max<size_t>(1, capacity)) {}
+
+    // false, если очередь закрыта
+    bool push(T x)
+    {
+        unique_lock<mutex> lock(mx);
+        not_full.wait(lock, [&]() { return closed || q.size() < cap; });
+        if (closed) {
+            return false;
+        }
+        q.push_back(std::move(x));
+        not_empty.notify_one();
+        return true;
+    }
+    // пусто, если очередь закрыта и все элементы выбраны
+    optional<T> pop()
+    {
+        unique_lock<mutex> lock(mx);
+        not_empty.wait(lock, [&]() { return closed || !q.empty(); });
+        if (q.empty()) {
+            return nullopt;
+        }
+        optional<T> x(std::move(q.front()));
+        q.pop_front();
+        not_full.notify_one();
+        return x;
+    }
+    // новые элементы не принимаются, оставшиеся можно выбрать
+    void close()
+    {
+        lock_guard<mutex> lock(mx);
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+};
+
+struct TStageStats
+{
+    size_t items = 0;
+    double busy = 0; // секунды работы
+    double wait = 0; // секунды ожидания на очередях
+    double throughput() const noexcept { return busy > 0 ? items / busy : 0; }
+};
+
+struct TPipelineStats
+{
+    TStageStats read, compute, write;
+    double wall = 0;
+    const char* bottleneck() const noexcept
+    {
+        return read.busy >= compute.busy && read.busy >= write.busy ? "read"
+            : compute.busy >= write.busy ? "compute" : "write";
+    }
+    friend ostream& operator<<(ostream& ostr, const TPipelineStats& st)
+    {
+        const pair<const char*, const TStageStats*> stages[] = {
+            { "read", &st.read }, { "compute", &st.compute }, { "write", &st.write } };
+        for (auto& s : stages) {
+            ostr << s.first << ": " << s.second->items << " jobs, busy " << s.second->busy << " s, wait "
+                << s.second->wait << " s, " << s.second->throughput() << " jobs/s\n";
+        }
+        return ostr << "wall " << st.wall << " s, bottleneck: " << st.bottleneck() << '\n';
+    }
+};
+
+inline double seconds_since(chrono::steady_clock::time_point t) noexcept
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - t).count();
+}
+
+// jobs заданий: read(i) -> X, compute(X&) -> Y, write(i, Y&). Ошибка любой
+// стадии останавливает остальные: уже стоящие в очередях элементы не
+// считаются и не записываются. Ошибка пробрасывается после их завершения.
+template<typename R, typename C, typename W>
+TPipelineStats run_pipeline(size_t jobs, R read, C compute, W write, size_t depth = 2)
+{
+    typedef decltype(read(size_t())) X;
+    typedef typename decay<decltype(compute(declval<X&>()))>::type Y;
+    TBoundedQueue<pair<size_t, X>> in(depth);
+    TBoundedQueue<pair<size_t, Y>> out(depth);
+    TPipelineStats st;
+    exception_ptr errors[3];
+    atomic<bool> failed(false);
+    auto stop = [&]() {
+        failed = true;
+        in.close();
+        out.close();
+    };
+    auto start = chrono::steady_clock::now();
+
+    thread reader([&]() {
+        try {
+            for (size_t i = 0; i < jobs; i++) {
+                auto t = chrono::steady_clock::now();
+                X x = read(i);
+                st.read.busy += seconds_since(t);
+                st.read.items++;
+                t = chrono::steady_clock::now();
+                bool ok = in.push({ i, std::move(x) });
+                st.read.wait += seconds_since(t);
+                if (!ok) {
+                    break;
+                }
+            }
+            in.close();
+        }
+        catch (...) {
+            errors[0] = current_exception();
+            stop();
+        }
+    });
+    thread writer([&]() {
+        try {
+            for (;;) {
+                auto t = chrono::steady_clock::now();
+                auto y = out.pop();
+                st.write.wait += seconds_since(t);
+                if (!y || failed) {
+                    break;
+                }
+                t = chrono::steady_clock::now();
+                write(y->first, y->second);
+                st.write.busy += seconds_since(t);
+                st.write.items++;
+            }
+        }
+        catch (...) {
+            errors[2] = current_exception();
+            stop();
+        }
+    });
+    try {
+        for (;;) {
+            auto t = chrono::steady_clock::now();
+            auto x = in.pop();
+            st.compute.wait += seconds_since(t);
+            if (!x || failed) {
+                break;
+            }
+            t = chrono::steady_clock::now();
+            Y y = compute(x->second);
+            st.compute.busy += seconds_since(t);
+            st.compute.items++;
+            t = chrono::steady_clock::now();
+            bool ok = out.push({ x->first, std::move(y) });
+            st.compute.wait += seconds_since(t);
+            if (!ok) {
+                break;
+            }
+        }
+        out.close();
+    }
+    catch (...) {
+        errors[1] = current_exception();
+        stop();
+    }
+    reader.join();
+    writer.join();
+    st.wall = seconds_since(start);
+    for (auto& e : errors) {
+        if (e) {
+            rethrow_exception(e);
+        }
+    }
+    return st;
+}
+
+// Пакетное задание: операция m (A * B), p (A + B) или d (A - B) над
+// матрицами двоичного формата из файлов a и b, результат - в файл out
+struct TBatchJob
+{
+    char op;
+    string a, b, out;
+};
+
+// файл заданий: строка "op a b out", пустые строки и строки с '#' пропускаются
+inline std::vector<TBatchJob> load_batch_jobs(const string& path)
+{
+    ifstream f(path);
+    if (!f) {
+        throw runtime_error("cannot open file " + path);
+    }
+    std::vector<TBatchJob> jobs;
+    string line;
+    for (size_t no = 1; getline(f, line); no++) {
+        size_t p = line.find_first_not_of(" \t\r");
+        if (p == string::npos || line[p] == '#') {
+            continue;
+        }
+        istringstream is(line);
+        string op;
+        TBatchJob job;
+        if (!(is >> op >> job.a >> job.b >> job.out) || op.size() != 1 || string("mpd").find(op[0]) == string::npos) {
+            throw invalid_argument("bad batch job at line " + to_string(no));
+        }
+        job.op = op[0];
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+// операнды задания, прочитанные целиком (копия представления читает файл
+// на стадии чтения, а не при счете)
+template<typename T>
+struct TBatchOperands
+{
+    char op;
+    TDynamicMatrix<T> a, b;
+};
+
+template<typename T>
+TDynamicMatrix<T> batch_compute(TBatchOperands<T>& x)
+{
+    return x.op == 'm' ? x.a * x.b : x.op == 'p' ? x.a + x.b : x.a - x.b;
+}
+
+template<typename T>
+TPipelineStats run_batch(const std::vector<TBatchJob>& jobs, size_t depth = 2)
+{
+    return run_pipeline(jobs.size(),
+        [&](size_t i) {
+            const TDynamicMatrix<T>& a = load_matrix_binary<T>(jobs[i].a);
+            const TDynamicMatrix<T>& b = load_matrix_binary<T>(jobs[i].b);
+            return TBatchOperands<T>{ jobs[i].op, TDynamicMatrix<T>(a), TDynamicMatrix<T>(b) };
+        },
+        batch_compute<T>,
+        [&](size_t i, TDynamicMatrix<T>& y) { save_matrix_binary(jobs[i].out, y); },
+        depth);
+}
+
+// Битовая матрица -
+// булева квадратная матрица, 64 элемента в слове uint64_t
+const int MAX_BIT_MATRIX_SIZE = 100000;
+
+inline size_t popcount64(uint64_t x) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (size_t)__builtin_popcountll(x);
+#else
+    return bitset<64>(x).count();
+#endif
+}
+
+// номер младшего единичного бита, x != 0
+inline size_t ctz64(uint64_t x) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (size_t)__builtin_ctzll(x);
+#else
+    return popcount64((x & (~x + 1)) - 1);
+#endif
+}
+
+class TBitMatrix
+{
+protected:
+    size_t sz;
+    size_t words; // слов в строке, биты за пределами sz всегда нулевые
+    std::vector<uint64_t> bits;
+public:
+    TBitMatrix(size_t s = 1) : sz(s)
+    {
+        if (sz == 0)
+            throw out_of_range("Matrix size should be greater than zero");
+        if (sz > MAX_BIT_MATRIX_SIZE)
+            throw length_error("bad matrix size");
+        words = (sz + 63) / 64;
+        bits.assign(sz * words, 0);
+    }
+    template<typename T>
+    explicit TBitMatrix(const TDynamicMatrix<T>& m) : TBitMatrix(m.size())
+    {
+        for (size_t i = 0; i < sz; i++)
+            for (size_t j = 0; j < sz; j++)
+                if (m[i][j] != T(0))
+                    set(i, j, true);
+    }
+
+    size_t size() const noexcept { return sz; }
+    size_t row_words() const noexcept { return words; }
+
+    uint64_t* row(size_t i) noexcept { return bits.data() + i * words; }
+    const uint64_t* row(size_t i) const noexcept { return bits.data() + i * words; }
+
+    // доступ к элементам
+    bool get(size_t i, size_t j) const noexcept
+    {
+        return (row(i)[j / 64] >> (j % 64)) & 1;
+    }
+    void set(size_t i, size_t j, bool val) noexcept
+    {
+        uint64_t mask = uint64_t(1) << (j % 64);
+        if (val)
+            row(i)[j / 64] |= mask;
+        else
+            row(i)[j / 64] &= ~mask;
+    }
+    bool at(size_t i, size_t j) const
+    {
+        if (i >= sz || j >= sz)
+            throw out_of_range("index out of range");
+        return get(i, j);
+    }
+
+    // число единиц
+    size_t count() const noexcept
+    {
+        size_t res = 0;
+        for (uint64_t w : bits)
+            res += popcount64(w);
+        return res;
+    }
+
+    template<typename T>
+    TDynamicMatrix<T> to_matrix() const
+    {
+        TDynamicMatrix<T> res(sz);
+        for (size_t i = 0; i < sz; i++)
+            for (size_t j = 0; j < sz; j++)
+                res[i][j] = get(i, j) ? T(1) : T(0);
+        return res;
+    }
+
+    // сравнение
+    bool operator==(const TBitMatrix& m) const noexcept
+    {
+        return sz == m.sz && bits == m.bits;
+    }
+    bool operator!=(const TBitMatrix& m) const noexcept
+    {
+        return !(*this == m);
+    }
+
+    // Умножение методом "четырех русских": k делится на группы по 8 строк B,
+    // для каждой группы строится таблица всех 256 комбинаций строк, после чего
+    // строка C обновляется одной строкой таблицы на группу. Потоки получают
+    // диапазоны строк C и строят таблицы независимо.
+    template<bool Xor>
+    static TBitMatrix multiply(const TBitMatrix& a, const TBitMatrix& b)
+    {
+        if (a.sz != b.sz)
+            throw length_error("different matrix sizes");
+        size_t n = a.sz, w = a.words;
+        TBitMatrix c(n);
+        parallel_for(0, n, [&](size_t lo, size_t hi) {
+            std::vector<uint64_t> table(256 * w);
+            for (size_t k0 = 0; k0 < n; k0 += 8) {
+                size_t kn = min<size_t>(8, n - k0);
+                std::fill(table.begin(), table.begin() + w, 0);
+                for (size_t mask = 1; mask < (size_t(1) << kn); mask++) {
+                    size_t low = 0;
+                    while (!((mask >> low) & 1))
+                        low++;
+                    const uint64_t* prev = table.data() + (mask & (mask - 1)) * w;
+                    const uint64_t* br = b.row(k0 + low);
+                    uint64_t* t = table.data() + mask * w;
+                    for (size_t q = 0; q < w; q++)
+                        t[q] = Xor ? prev[q] ^ br[q] : prev[q] | br[q];
+                }
+                for (size_t i = lo; i < hi; i++) {
+                    size_t sel = (a.row(i)[k0 / 64] >> (k0 % 64)) & 0xFF;
+                    if (sel == 0)
+                        continue;
+                    const uint64_t* t = table.data() + sel * w;
+                    uint64_t* ci = c.row(i);
+                    for (size_t q = 0; q < w; q++)
+                        ci[q] = Xor ? ci[q] ^ t[q] : ci[q] | t[q];
+                }
+            }
+        }, n * w);
+        return c;
+    }
+
+    // булево произведение (OR-AND)
+    TBitMatrix operator*(const TBitMatrix& m) const
+    {
+        return multiply<false>(*this, m);
+    }
+    // произведение над GF(2) (XOR-AND)
+    TBitMatrix mul_gf2(const TBitMatrix& m) const
+    {
+        return multiply<true>(*this, m);
+    }
+
+    // Приведение к ступенчатому виду над GF(2), возвращает ранг.
+    // Строки ниже ведущей исключаются параллельно XOR целыми словами.
+    size_t gauss_gf2()
+    {
+        size_t r = 0;
+        for (size_t c = 0; c < sz && r < sz; c++) {
+            size_t q = r;
+            while (q < sz && !get(q, c))
+                q++;
+            if (q == sz)
+                continue;
+            if (q != r)
+                std::swap_ranges(row(q), row(q) + words, row(r));
+            const uint64_t* pr = row(r);
+            size_t w0 = c / 64;
+            parallel_for(r + 1, sz, [&](size_t lo, size_t hi) {
+                for (size_t i = lo; i < hi; i++) {
+                    if (!get(i, c))
+                        continue;
+                    uint64_t* ri = row(i);
+                    for (size_t q2 = w0; q2 < words; q2++)
+                        ri[q2] ^= pr[q2];
+                }
+            }, words - w0);
+            r++;
+        }
+        return r;
+    }
+    size_t rank_gf2() const
+    {
+        TBitMatrix tmp(*this);
+        return tmp.gauss_gf2();
+    }
+
+    // Транзитивное замыкание: строка i - множество вершин, достижимых из i
+    // за один и более шагов. Строки независимы и считаются обходом по
+    // исходной матрице за один параллельный проход: вершина j, впервые
+    // попавшая в строку, добавляет к ней строку j. Работа O(n^2 * words),
+    // как у алгоритма Уоршелла, но без синхронизации на каждом k.
+    TBitMatrix transitive_closure() const
+    {
+        TBitMatrix res(*this);
+        parallel_for(0, sz, [&](size_t lo, size_t hi) {
+            std::vector<uint64_t> done(words);
+            for (size_t i = lo; i < hi; i++) {
+                uint64_t* ri = res.row(i);
+                fill(done.begin(), done.end(), 0);
+                bool grown = true;
+                while (grown) {
+                    grown = false;
+                    for (size_t q = 0; q < words; q++) {
+                        while (uint64_t fresh = ri[q] & ~done[q]) {
+                            uint64_t low = fresh & (~fresh + 1);
+                            done[q] |= low;
+                            const uint64_t* rj = row(q * 64 + ctz64(low));
+                            for (size_t w = 0; w < words; w++)
+                                ri[w] |= rj[w];
+                            grown = true;
+                        }
+                    }
+                }
+            }
+        }, sz * words);
+        return res;
+    }
+
+    // ввод/вывод
+    friend ostream& operator<<(ostream& ostr, const TBitMatrix& m)
+    {
+        for (size_t i = 0; i < m.sz; i++) {
+            for (size_t j = 0; j < m.sz; j++)
+                ostr << (m.get(i, j) ? '1' : '0');
+            ostr << '\n';
+        }
         return ostr;
     }
 };
@@ -8,9 +8,26 @@
 #include "tmatrix.h"
 //---------------------------------------------------------------------------
 
-void main()
+// пакетный режим: matrix batch <файл заданий> [double]
+int run_batch_mode(const string& jobs_file, bool real)
+{
+	try {
+		vector<TBatchJob> jobs = load_batch_jobs(jobs_file);
+		TPipelineStats st = real ? run_batch<double>(jobs) : run_batch<int>(jobs);
+		cout << st;
+	}
+	catch (const exception& e) {
+		cerr << "Ошибка: " << e.what() << '\n';
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char* argv[])
 {
 	setlocale(LC_ALL, "Russian");
+	if (argc >= 3 && string(argv[1]) == "batch")
+		return run_batch_mode(argv[2], argc >= 4 && string(argv[3]) == "double");
 	cout << "Введите размеры матриц\n";
 	int size;
 	cin >> size;
@@ -0,0 +1,100 @@
+#include "tmatrix.h"
+#include <gtest.h>
+
+TEST(TBitMatrix, can_create_matrix_with_positive_length)
+{
+	ASSERT_NO_THROW(TBitMatrix m(100));
+}
+TEST(TBitMatrix, cant_create_too_large_matrix)
+{
+	ASSERT_ANY_THROW(TBitMatrix m(MAX_BIT_MATRIX_SIZE + 1));
+}
+TEST(TBitMatrix, throws_when_create_matrix_with_zero_length)
+{
+	ASSERT_ANY_THROW(TBitMatrix m(0));
+}
+
+TEST(TBitMatrix, can_set_and_get_element)
+{
+	TBitMatrix m(130);
+	m.set(3, 129, true);
+	m.set(129, 64, true);
+	EXPECT_TRUE(m.get(3, 129));
+	EXPECT_TRUE(m.get(129, 64));
+	EXPECT_FALSE(m.get(3, 128));
+	EXPECT_EQ(size_t(2), m.count());
+	m.set(3, 129, false);
+	EXPECT_EQ(size_t(1), m.count());
+	ASSERT_ANY_THROW(m.at(130, 0));
+}
+
+TEST(TBitMatrix, boolean_product_matches_dense_product)
+{
+	int n = 150;
+	TDynamicMatrix<int> a(n), b(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++) {
+			a[i][j] = (i * 7 + j * 13) % 17 == 0;
+			b[i][j] = (i * 5 + j * 3) % 23 == 0;
+		}
+	TDynamicMatrix<int> c = a * b;
+	set_thread_count(3);
+	TBitMatrix bc = TBitMatrix(a) * TBitMatrix(b);
+	TBitMatrix gc = TBitMatrix(a).mul_gf2(TBitMatrix(b));
+	set_thread_count(0);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++) {
+			EXPECT_EQ(c[i][j] != 0, bc.get(i, j));
+			EXPECT_EQ(c[i][j] % 2 != 0, gc.get(i, j));
+		}
+}
+
+TEST(TBitMatrix, gf2_rank_of_dependent_rows)
+{
+	TBitMatrix m(70);
+	for (int j = 0; j < 70; j += 3) {
+		m.set(0, j, true);
+		m.set(1, j + 1 < 70 ? j + 1 : 0, true);
+	}
+	for (int j = 0; j < 70; j++)
+		m.set(2, j, m.get(0, j) != m.get(1, j));
+	m.set(5, 69, true);
+	EXPECT_EQ(size_t(3), m.rank_gf2());
+	EXPECT_EQ(size_t(3), m.gauss_gf2());
+}
+
+TEST(TBitMatrix, transitive_closure_of_chain)
+{
+	int n = 100;
+	TBitMatrix m(n);
+	for (int i = 0; i + 1 < n; i++)
+		m.set(i, i + 1, true);
+	TBitMatrix c = m.transitive_closure();
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			EXPECT_EQ(j > i, c.get(i, j));
+}
+
+TEST(TBitMatrix, transitive_closure_matches_warshall)
+{
+	int n = 300;
+	TBitMatrix m(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			m.set(i, j, (i * 7919 + j * 104729) % 509 == 0);
+	vector<vector<bool>> r(n, vector<bool>(n));
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			r[i][j] = m.get(i, j);
+	for (int k = 0; k < n; k++)
+		for (int i = 0; i < n; i++)
+			if (r[i][k])
+				for (int j = 0; j < n; j++)
+					r[i][j] = r[i][j] || r[k][j];
+	set_thread_count(4);
+	TBitMatrix c = m.transitive_closure();
+	set_thread_count(0);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			ASSERT_EQ(r[i][j], c.get(i, j));
+}
@@ -1,5 +1,6 @@
 #include "tmatrix.h"
 #include <ctime>
+#include <sstream>
 #include <gtest.h>
 
 TEST(TDynamicMatrix, can_create_matrix_with_positive_length)
@@ -248,3 +249,1344 @@ TEST(TDynamicMatrix, cant_subtract_matrixes_with_not_equal_size)
 	TDynamicMatrix<int> b(11);
 	ASSERT_ANY_THROW(a - b);
 }
+
+TEST(TDynamicMatrix, trsv_solves_lower_triangular_system)
+{
+	int n = 150;
+	TDynamicMatrix<double> a(n);
+	TDynamicVector<double> x(n), b(n);
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j <= i; j++)
+			a[i][j] = (i == j) ? 4.0 : 1.0 / (i + j + 1);
+		x[i] = i % 7 - 3;
+	}
+	b = a * x;
+	trsv(a, b, TTriangle::lower);
+	for (int i = 0; i < n; i++)
+		EXPECT_NEAR(x[i], b[i], 1e-9);
+}
+
+TEST(TDynamicMatrix, trsm_solves_upper_triangular_system)
+{
+	int n = 130;
+	TDynamicMatrix<double> a(n), x(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++) {
+			if (j >= i)
+				a[i][j] = (i == j) ? 2.0 + i % 3 : 0.5 / (j - i + 1);
+			x[i][j] = (i * 3 + j) % 11 - 5;
+		}
+	TDynamicMatrix<double> b = a * x;
+	set_thread_count(4);
+	trsm(a, b, TTriangle::upper);
+	set_thread_count(0);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			EXPECT_NEAR(x[i][j], b[i][j], 1e-9);
+}
+
+TEST(TDynamicMatrix, trsm_throws_on_zero_diagonal)
+{
+	TDynamicMatrix<double> a(3), b(3);
+	a[0][0] = 1; a[2][2] = 1;
+	ASSERT_ANY_THROW(trsm(a, b, TTriangle::lower));
+}
+
+TEST(TDynamicMatrix, bareiss_computes_exact_determinant)
+{
+	TDynamicMatrix<int> a(3);
+	int v[3][3] = { { 2, -3, 1 }, { 2, 0, -1 }, { 1, 4, 5 } };
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			a[i][j] = v[i][j];
+	EXPECT_EQ(49, det_bareiss(a));
+	EXPECT_EQ(3u, rank_bareiss(a));
+}
+
+TEST(TDynamicMatrix, bareiss_computes_rank_of_singular_matrix)
+{
+	int n = 20;
+	TDynamicMatrix<int> a(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			a[i][j] = (i % 4 + 1) * (j + 1) + (i % 4) * j * j;
+	EXPECT_EQ(0, det_bareiss(a));
+	EXPECT_EQ(2u, rank_bareiss(a));
+}
+
+TEST(TDynamicMatrix, bareiss_throws_on_overflow)
+{
+	int n = 12;
+	TDynamicMatrix<int> a(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			a[i][j] = (i == j) ? 2000000000 : (i * 7 + j * 3) % 1000;
+	ASSERT_ANY_THROW(det_bareiss(a));
+}
+
+TEST(TDynamicMatrix, multimodular_determinant_matches_bareiss)
+{
+	int n = 30;
+	TDynamicMatrix<int> a(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			a[i][j] = (i == j) ? 3 : ((i * 31 + j * 17) % 5) - 2;
+	EXPECT_EQ(det_bareiss(a), det_multimodular(a));
+}
+
+TEST(TDynamicMatrix, multimodular_determinant_of_large_entries)
+{
+	TDynamicMatrix<int> a(2);
+	a[0][0] = 2000000000; a[0][1] = 3;
+	a[1][0] = -7; a[1][1] = 2000000001;
+	EXPECT_EQ(2000000000LL * 2000000001LL + 21, det_multimodular(a));
+	TDynamicMatrix<int> b(3);
+	for (int i = 0; i < 3; i++)
+		b[i][i] = 2000000000;
+	ASSERT_THROW(det_multimodular(b), overflow_error);
+}
+
+TEST(TDynamicMatrix, multimodular_determinant_never_returns_inexact_value)
+{
+	// оценка Адамара ~2^310, модулей не хватает: решает метод Барейса
+	int n = 10;
+	TDynamicMatrix<int64_t> a(n);
+	for (int i = 0; i < n; i++)
+		a[i][i] = 2000000000;
+	ASSERT_THROW(det_multimodular(a), overflow_error);
+	// det = 1 + n * 2000000000 при оценке Адамара ~2^326
+	TDynamicMatrix<int64_t> b(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			b[i][j] = (i == j) ? 2000000001 : 2000000000;
+	EXPECT_EQ(20000000001LL, det_multimodular(b));
+}
+
+TEST(TDynamicMatrix, nested_parallel_for_runs_in_calling_thread)
+{
+	set_thread_count(4);
+	std::vector<int> nested(4, 0);
+	parallel_for(0, 4, [&](size_t lo, size_t hi) {
+		for (size_t t = lo; t < hi; t++) {
+			thread::id self = this_thread::get_id();
+			parallel_for(0, 1 << 20, [&](size_t, size_t) {
+				if (this_thread::get_id() != self)
+					nested[t] = -1;
+				else if (nested[t] == 0)
+					nested[t] = 1;
+			});
+		}
+	}, PARALLEL_MIN_WORK);
+	set_thread_count(0);
+	for (int t = 0; t < 4; t++)
+		EXPECT_EQ(1, nested[t]);
+}
+
+TEST(TDynamicMatrix, mod_gemm_matches_reduced_product)
+{
+	int n = 70;
+	const int64_t p = 1000000007;
+	TModulus m(p);
+	TDynamicMatrix<int64_t> a(n), b(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++) {
+			a[i][j] = ((int64_t)i * 7919 + (int64_t)j * 104729) * 977 % p - p / 2;
+			b[i][j] = ((int64_t)i * 15485863 + (int64_t)j * 32452843) % p;
+		}
+	TDynamicMatrix<int64_t> c = mod_gemm(a, b, m);
+	for (int i = 0; i < n; i += 13)
+		for (int j = 0; j < n; j += 7) {
+			uint64_t s = 0;
+			for (int k = 0; k < n; k++)
+				s = (s + m.residue(a[i][k]) * m.residue(b[k][j])) % p;
+			EXPECT_EQ((int64_t)s, c[i][j]);
+		}
+}
+
+TEST(TDynamicMatrix, mod_inverse_gives_identity)
+{
+	int n = 40;
+	TModulus m(998244353);
+	TDynamicMatrix<int64_t> a(n), e(n);
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < n; j++)
+			a[i][j] = (i * 7919 + j * j * 31 + i * j * 17) % 101;
+		e[i][i] = 1;
+	}
+	TDynamicMatrix<int64_t> inv = mod_inverse(a, m);
+	EXPECT_EQ(e, mod_gemm(a, inv, m));
+	EXPECT_EQ(e, mod_gemm(inv, a, m));
+}
+
+TEST(TDynamicMatrix, mod_elimination_detects_singular_matrix)
+{
+	TModulus m(7);
+	TDynamicMatrix<int64_t> a(3);
+	int64_t v[3][3] = { { 1, 2, 3 }, { 4, 5, 6 }, { 0, 1, 9 } };
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			a[i][j] = v[i][j];
+	EXPECT_EQ(size_t(2), mod_rank(a, m));
+	EXPECT_EQ(uint64_t(0), mod_det(a, m));
+	ASSERT_ANY_THROW(mod_inverse(a, m));
+	EXPECT_EQ(uint64_t(1), mod_det(a, TModulus(11)));
+}
+
+TEST(TDynamicMatrix, cant_create_too_large_or_composite_modulus)
+{
+	ASSERT_ANY_THROW(TModulus m((uint64_t)1 << 31));
+	ASSERT_ANY_THROW(TModulus m(1));
+	ASSERT_THROW(TModulus m(4), invalid_argument);
+	ASSERT_THROW(TModulus m(6), invalid_argument);
+	ASSERT_THROW(TModulus m(561), invalid_argument);
+	// сильное псевдопростое по основаниям 2, 3, 5
+	ASSERT_THROW(TModulus m(25326001), invalid_argument);
+	ASSERT_THROW(TModulus m(2147483645), invalid_argument);
+	ASSERT_NO_THROW(TModulus m(2));
+	ASSERT_NO_THROW(TModulus m(2147483647));
+}
+
+TEST(TDynamicMatrix, min_plus_product_of_distance_matrices)
+{
+	const double inf = numeric_limits<double>::infinity();
+	TDynamicMatrix<double> a(3);
+	double v[3][3] = { { 0, 4, inf }, { inf, 0, 1 }, { 2, inf, 0 } };
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			a[i][j] = v[i][j];
+	TDynamicMatrix<double> c = gemm<TMinPlus>(a, a);
+	EXPECT_EQ(5, c[0][2]);
+	EXPECT_EQ(3, c[1][0]);
+	EXPECT_EQ(6, c[2][1]);
+	EXPECT_EQ(0, c[1][1]);
+}
+
+TEST(TDynamicMatrix, shortest_paths_on_integer_cycle)
+{
+	int n = 40;
+	const int inf = TMinPlus<int>::zero();
+	TDynamicMatrix<int> a(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			a[i][j] = (j == (i + 1) % n) ? 1 : inf;
+	TDynamicMatrix<int> d = shortest_paths(a);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			EXPECT_EQ((j - i + n) % n, d[i][j]);
+}
+
+TEST(TDynamicMatrix, max_min_closure_gives_bottleneck_paths)
+{
+	TDynamicMatrix<int> a(3);
+	a[0][1] = 5; a[1][2] = 3; a[0][2] = 2;
+	TDynamicMatrix<int> c = semiring_closure<TMaxMin>(a);
+	EXPECT_EQ(3, c[0][2]);
+	EXPECT_EQ(0, c[2][0]);
+}
+
+TEST(TDynamicMatrix, or_and_product_gives_reachability_in_two_steps)
+{
+	TDynamicMatrix<int> a(3);
+	a[0][1] = 7; a[1][2] = 1;
+	TDynamicMatrix<int> c = gemm<TOrAnd>(a, a);
+	EXPECT_EQ(1, c[0][2]);
+	EXPECT_EQ(0, c[0][1]);
+}
+
+TEST(TDynamicMatrix, matrices_with_different_size_are_not_equal_both_ways)
+{
+	TDynamicMatrix<int> a(5);
+	TDynamicMatrix<int> b(1);
+	EXPECT_NE(a, b);
+	EXPECT_NE(b, a);
+}
+
+TEST(TDynamicMatrix, approx_equal_matrices_with_tolerance)
+{
+	int n = 300;
+	TDynamicMatrix<double> a(n), b(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++) {
+			a[i][j] = 1.0 / (i + j + 1);
+			b[i][j] = a[i][j] + 1e-12;
+		}
+	set_thread_count(4);
+	EXPECT_NE(a, b);
+	EXPECT_TRUE(approx_equal(a, b, TTolerance(1e-10)));
+	b[n - 1][n - 1] += 1;
+	EXPECT_FALSE(approx_equal(a, b, TTolerance(1e-10)));
+	set_thread_count(0);
+}
+
+TEST(TDynamicMatrix, diff_of_equal_matrices_is_empty)
+{
+	TDynamicMatrix<int> a(20);
+	a[3][4] = 7;
+	TDiffReport r = diff(a, a);
+	EXPECT_TRUE(r.equal());
+	EXPECT_EQ(DIFF_NPOS, r.first);
+	EXPECT_EQ(0, r.max_abs);
+}
+
+TEST(TDynamicMatrix, diff_locates_mismatches_and_max_errors)
+{
+	int n = 200;
+	TDynamicMatrix<double> a(n), b(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			a[i][j] = b[i][j] = i + j + 1.0;
+	b[5][7] += 0.5;
+	b[150][3] += 3;
+	b[2][1] += 1;
+	set_thread_count(4);
+	TDiffReport r = diff(a, b);
+	set_thread_count(0);
+	EXPECT_FALSE(r.equal());
+	EXPECT_EQ(3, r.count);
+	EXPECT_EQ(2 * n + 1, r.first);
+	EXPECT_EQ(3, r.max_abs);
+	EXPECT_EQ(150 * n + 3, r.max_abs_pos);
+	EXPECT_EQ(2 * n + 1, r.max_rel_pos);
+	EXPECT_NEAR(0.2, r.max_rel, 1e-12);
+}
+
+TEST(TDynamicMatrix, cant_diff_matrices_with_not_equal_size)
+{
+	TDynamicMatrix<int> a(3), b(4);
+	ASSERT_ANY_THROW(diff(a, b));
+}
+
+TEST(TDynamicMatrix, can_compute_matrix_reductions)
+{
+	TDynamicMatrix<int> a(3);
+	int v[3][3] = { { 1, -2, 3 }, { -4, 5, -6 }, { 7, -8, 9 } };
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			a[i][j] = v[i][j];
+	EXPECT_EQ(5, sum(a));
+	EXPECT_EQ(15, trace(a));
+	EXPECT_EQ(18, norm1(a));
+	EXPECT_EQ(24, norm_inf(a));
+	EXPECT_NEAR(sqrt(285.0), frobenius_norm(a), 1e-12);
+	EXPECT_EQ(-8, min_value(a));
+	EXPECT_EQ(9, max_value(a));
+	EXPECT_EQ(8, argmax(a));
+}
+
+TEST(TDynamicMatrix, reproducible_sum_does_not_depend_on_thread_count)
+{
+	int n = 700;
+	TDynamicMatrix<double> a(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			a[i][j] = 1.0 / (i + 1) - 1.0 / (j + 2);
+	set_thread_count(1);
+	double s1 = sum(a, TReduceMode::reproducible);
+	set_thread_count(4);
+	double s4 = sum(a, TReduceMode::reproducible);
+	set_thread_count(0);
+	EXPECT_EQ(0, memcmp(&s1, &s4, sizeof(double)));
+}
+
+TEST(TDynamicMatrix, wide_product_of_int_matrices_does_not_overflow)
+{
+	int n = 50;
+	TDynamicMatrix<int> a(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			a[i][j] = 1000000;
+	TDynamicMatrix<int64_t> c = gemm_acc<TWideSum>(a, a);
+	EXPECT_EQ(50000000000000LL, c[7][3]);
+}
+
+TEST(TDynamicMatrix, accumulation_policies_agree_with_double_product)
+{
+	int n = 300;
+	TDynamicMatrix<float> a(n);
+	TDynamicMatrix<double> ad(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			ad[i][j] = a[i][j] = 1.0f / (1 + (i * 31 + j * 17) % 97);
+	TDynamicMatrix<double> ref = ad * ad;
+	TDynamicMatrix<float> k = gemm_acc<TKahanSum>(a, a);
+	TDynamicMatrix<float> p = gemm_acc<TPairwiseSum>(a, a);
+	TDynamicMatrix<double> w = gemm_acc<TWideSum>(a, a);
+	TDynamicMatrix<float> s = gemm_acc<TNaiveSum>(a, a);
+	for (int i = 0; i < n; i += 17)
+		for (int j = 0; j < n; j += 13) {
+			EXPECT_NEAR(ref[i][j], k[i][j], ref[i][j] * 1e-6);
+			EXPECT_NEAR(ref[i][j], p[i][j], ref[i][j] * 1e-6);
+			EXPECT_NEAR(ref[i][j], w[i][j], ref[i][j] * 1e-12);
+			EXPECT_NEAR(ref[i][j], s[i][j], ref[i][j] * 1e-4);
+		}
+}
+
+TEST(TDynamicMatrix, elementwise_math_in_place)
+{
+	int n = 120;
+	TDynamicMatrix<double> a(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			a[i][j] = 0.01 * (i - j);
+	TDynamicMatrix<double> t = vtanh(a);
+	vexp_inplace(a);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++) {
+			EXPECT_NEAR(exp(0.01 * (i - j)), a[i][j], a[i][j] * 1e-15);
+			EXPECT_NEAR(tanh(0.01 * (i - j)), t[i][j], 1e-15);
+		}
+}
+
+TEST(TDynamicMatrix, can_map_zip_and_transform)
+{
+	int n = 200;
+	TDynamicMatrix<int> a(n), b(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++) {
+			a[i][j] = i - j;
+			b[i][j] = i + j;
+		}
+	set_thread_count(4);
+	TDynamicMatrix<int> h = a.zip(b, [](int x, int y) { return x * y; }, TExecution::par);
+	TDynamicMatrix<double> d = a.map([](int x) { return x / 2.0; });
+	a.transform([](int x) { return x < 0 ? 0 : x; }, TExecution::par);
+	set_thread_count(0);
+	for (int i = 0; i < n; i += 7)
+		for (int j = 0; j < n; j += 11) {
+			EXPECT_EQ((i - j) * (i + j), h[i][j]);
+			EXPECT_EQ((i - j) / 2.0, d[i][j]);
+			EXPECT_EQ(i > j ? i - j : 0, a[i][j]);
+		}
+}
+
+TEST(TDynamicMatrix, can_compute_hadamard_product_and_quotient)
+{
+	int n = 50;
+	TDynamicMatrix<int> a(n), b(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++) {
+			a[i][j] = (i + 1) * (j + 2);
+			b[i][j] = j + 2;
+		}
+	TDynamicMatrix<int> h = hadamard(a, b);
+	TDynamicMatrix<int> d = divide(a, b);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++) {
+			EXPECT_EQ((i + 1) * (j + 2) * (j + 2), h[i][j]);
+			EXPECT_EQ(i + 1, d[i][j]);
+		}
+	divide_inplace(h, b);
+	EXPECT_EQ(a, h);
+	hadamard_inplace(h, b);
+	EXPECT_EQ(hadamard(a, b), h);
+}
+
+TEST(TDynamicMatrix, cant_divide_integer_matrix_by_zero)
+{
+	TDynamicMatrix<int> a(3), b(3);
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			b[i][j] = 1;
+	b[2][1] = 0;
+	ASSERT_THROW(divide(a, b), domain_error);
+	ASSERT_THROW(divide(TDynamicMatrix<int>(4), b), length_error);
+	ASSERT_THROW(divide_inplace(a, TDynamicMatrix<int>(4)), length_error);
+	ASSERT_ANY_THROW(hadamard(a, TDynamicMatrix<int>(4)));
+}
+
+TEST(TDynamicMatrix, can_broadcast_vector_to_rows_and_columns)
+{
+	int n = 4;
+	TDynamicMatrix<double> a(n);
+	TDynamicVector<double> v(n);
+	for (int i = 0; i < n; i++)
+		v[i] = 10.0 * i;
+	TDynamicMatrix<double> r = add_to_rows(a, v), c = add_to_cols(a, v);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++) {
+			EXPECT_EQ(10.0 * j, r[i][j]);
+			EXPECT_EQ(10.0 * i, c[i][j]);
+		}
+	add_to_rows_inplace(a, v);
+	EXPECT_EQ(r, a);
+	broadcast_cols_inplace(a, v, [](double x, double y) { return x * y; });
+	EXPECT_EQ(100.0 * 3 * 2, a[3][2]);
+	ASSERT_ANY_THROW(add_to_rows(a, TDynamicVector<double>(n + 1)));
+}
+
+TEST(TDynamicMatrix, ger_adds_outer_product)
+{
+	int n = 60;
+	TDynamicMatrix<double> a(n);
+	TDynamicVector<double> x(n), y(n);
+	for (int i = 0; i < n; i++) {
+		x[i] = i;
+		y[i] = 1.0 / (i + 1);
+		a[i][i] = 1;
+	}
+	ger(a, 2.0, x, y);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			EXPECT_DOUBLE_EQ((i == j) + 2.0 * i / (j + 1), a[i][j]);
+	TDynamicMatrix<double> o = outer(x, y);
+	EXPECT_DOUBLE_EQ(5.0 / 3, o[5][2]);
+	ASSERT_ANY_THROW(ger(a, 1.0, x, TDynamicVector<double>(n + 1)));
+}
+
+TEST(TDynamicMatrix, syrk_updates_only_requested_triangle)
+{
+	int n = 75;
+	TDynamicMatrix<double> a(n), at(n), c(n), cu(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++) {
+			a[i][j] = ((i * 13 + j * 7) % 17) - 8.0;
+			at[j][i] = a[i][j];
+			c[i][j] = cu[i][j] = 1;
+		}
+	for (int i = 0; i < n; i++)
+		cu[i][n - 1 - i] = (i % 2) ? numeric_limits<double>::quiet_NaN() : numeric_limits<double>::infinity();
+	TDynamicMatrix<double> aat = a * at, ata = at * a;
+	set_thread_count(3);
+	syrk(c, a, 2.0, 0.5);
+	syrk(cu, a, 1.0, 0.0, TTriangle::upper, TTranspose::trans);
+	set_thread_count(0);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++) {
+			EXPECT_DOUBLE_EQ(j <= i ? 2 * aat[i][j] + 0.5 : 1, c[i][j]);
+			if (j >= i)
+				EXPECT_DOUBLE_EQ(ata[i][j], cu[i][j]);
+			else if (j != n - 1 - i)
+				EXPECT_DOUBLE_EQ(1, cu[i][j]);
+		}
+}
+
+TEST(TDynamicMatrix, can_compute_kronecker_product)
+{
+	TDynamicMatrix<int> a(2), b(3);
+	a[0][0] = 1; a[0][1] = 2; a[1][0] = 3; a[1][1] = 4;
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			b[i][j] = i * 3 + j;
+	TDynamicMatrix<int> k = kron(a, b);
+	EXPECT_EQ(6, k.size());
+	for (int i = 0; i < 6; i++)
+		for (int j = 0; j < 6; j++)
+			EXPECT_EQ(a[i / 3][j / 3] * b[i % 3][j % 3], k[i][j]);
+	ASSERT_ANY_THROW(kron(TDynamicMatrix<int>(101), TDynamicMatrix<int>(100)));
+}
+
+TEST(TDynamicMatrix, implicit_kronecker_operator_matches_explicit_product)
+{
+	int n = 7, m = 11;
+	TDynamicMatrix<double> a(n), b(m);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			a[i][j] = (i + 2 * j) % 5 - 2;
+	for (int i = 0; i < m; i++)
+		for (int j = 0; j < m; j++)
+			b[i][j] = 1.0 / (i + j + 1);
+	TDynamicVector<double> v(n * m);
+	for (int i = 0; i < n * m; i++)
+		v[i] = i % 9 - 4;
+	TKroneckerOperator<double> op(a, b);
+	TDynamicVector<double> y = op * v;
+	TDynamicVector<double> ref = kron(a, b) * v;
+	EXPECT_EQ(n * m, op.size());
+	for (int i = 0; i < n * m; i++)
+		EXPECT_NEAR(ref[i], y[i], 1e-12);
+	ASSERT_ANY_THROW(op * TDynamicVector<double>(n));
+}
+
+TEST(TDynamicMatrix, can_raise_matrix_to_power)
+{
+	TDynamicMatrix<int64_t> f(2);
+	f[0][0] = 1; f[0][1] = 1; f[1][0] = 1;
+	TDynamicMatrix<int64_t> p = pow(f, 50);
+	EXPECT_EQ(12586269025LL, p[0][1]);
+	EXPECT_EQ(20365011074LL, p[0][0]);
+	TDynamicMatrix<int64_t> e = pow(f, 0);
+	EXPECT_EQ(1, e[0][0]);
+	EXPECT_EQ(0, e[0][1]);
+	EXPECT_EQ(f, pow(f, 1));
+}
+
+TEST(TDynamicMatrix, polyval_matches_horner_evaluation)
+{
+	int n = 12;
+	TDynamicMatrix<double> a(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			a[i][j] = ((i * 5 + j * 3) % 7 - 3) * 0.1;
+	for (int d = 0; d < 12; d++) {
+		TDynamicVector<double> c(d + 1);
+		for (int i = 0; i <= d; i++)
+			c[i] = (i % 3) - 1.0 + 0.5 * i;
+		TDynamicMatrix<double> ref(n);
+		for (int i = d; i >= 0; i--) {
+			ref = ref * a;
+			for (int q = 0; q < n; q++)
+				ref[q][q] += c[i];
+		}
+		TDynamicMatrix<double> p = polyval(a, c);
+		for (int i = 0; i < n; i++)
+			for (int j = 0; j < n; j++)
+				EXPECT_NEAR(ref[i][j], p[i][j], 1e-12);
+	}
+}
+
+TEST(TDynamicMatrix, can_parse_matrix_text)
+{
+	string text = "1.5 -2 +3\r\n\n 4e1\t5 6\n7 8 9e-1";
+	TDynamicMatrix<double> m = parse_matrix<double>(text.data(), text.size());
+	ASSERT_EQ(3, m.size());
+	EXPECT_EQ(1.5, m[0][0]);
+	EXPECT_EQ(3.0, m[0][2]);
+	EXPECT_EQ(40.0, m[1][0]);
+	EXPECT_EQ(0.9, m[2][2]);
+}
+
+TEST(TDynamicMatrix, cant_parse_bad_matrix_text)
+{
+	string ragged = "1 2\n3\n";
+	string extra = "1 2 3\n4 5\n";
+	string junk = "1 2\n3 x\n";
+	ASSERT_ANY_THROW(parse_matrix<int>(ragged.data(), ragged.size()));
+	ASSERT_ANY_THROW(parse_matrix<int>(extra.data(), extra.size()));
+	ASSERT_ANY_THROW(parse_matrix<int>(junk.data(), junk.size()));
+	ASSERT_ANY_THROW(parse_matrix<int>(" \n\n", 3));
+}
+
+TEST(TDynamicMatrix, load_matrix_text_reads_operator_output)
+{
+	int n = 150;
+	TDynamicMatrix<int> m(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			m[i][j] = (i * 31 + j * 17) % 1001 - 500;
+	const char* path = "test_tmatrix_text.tmp";
+	{
+		ofstream f(path);
+		f << m;
+	}
+	set_thread_count(4);
+	TDynamicMatrix<int> r = load_matrix_text<int>(path);
+	set_thread_count(0);
+	remove(path);
+	EXPECT_EQ(m, r);
+	ASSERT_ANY_THROW(load_matrix_text<int>("no_such_file.tmp"));
+}
+
+TEST(TDynamicMatrix, write_matrix_text_round_trips_exactly)
+{
+	int n = 700;
+	TDynamicMatrix<double> m(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			m[i][j] = sin(i * 0.37 + j * 1.91) * pow(10.0, (i + j) % 9 - 4);
+	ostringstream seq, par;
+	write_matrix_text(seq, m);
+	set_thread_count(4);
+	write_matrix_text(par, m, TExecution::par);
+	set_thread_count(0);
+	EXPECT_EQ(seq.str(), par.str());
+	string text = seq.str();
+	TDynamicMatrix<double> r = parse_matrix<double>(text.data(), text.size());
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			ASSERT_EQ(m[i][j], r[i][j]);
+}
+
+TEST(TDynamicMatrix, binary_round_trip_gives_view_over_file)
+{
+	int n = 300;
+	TDynamicMatrix<double> m(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			m[i][j] = i * 0.25 - j * 3.5;
+	const char* path = "test_tmatrix_bin.tmp";
+	save_matrix_binary(path, m);
+	{
+		TDynamicMatrix<double> r = load_matrix_binary<double>(path, true);
+#ifndef _WIN32
+		EXPECT_TRUE(r.is_view());
+#endif
+		EXPECT_EQ(m, r);
+		r[0][0] = 100.0;
+		TDynamicMatrix<double> s = r + m;
+		EXPECT_FALSE(s.is_view());
+		EXPECT_EQ(m[5][7] * 2, s[5][7]);
+		TDynamicMatrix<double> c(r);
+		EXPECT_FALSE(c.is_view());
+		EXPECT_EQ(100.0, c[0][0]);
+	}
+	EXPECT_EQ(m, load_matrix_binary<double>(path));
+	ASSERT_ANY_THROW(load_matrix_binary<float>(path));
+	ASSERT_ANY_THROW(load_vector_binary<double>(path));
+	remove(path);
+}
+
+TEST(TDynamicMatrix, binary_load_transposes_column_major_data)
+{
+	int n = 5;
+	TDynamicMatrix<int> m(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			m[i][j] = i * 10 + j;
+	const char* path = "test_tmatrix_bin_col.tmp";
+	save_matrix_binary(path, m);
+	{
+		fstream f(path, ios::in | ios::out | ios::binary);
+		TBinaryHeader h;
+		f.read(reinterpret_cast<char*>(&h), sizeof(h));
+		h.layout = 1;
+		f.seekp(0);
+		f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	}
+	TDynamicMatrix<int> r = load_matrix_binary<int>(path, true);
+	remove(path);
+	EXPECT_FALSE(r.is_view());
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			EXPECT_EQ(m[j][i], r[i][j]);
+}
+
+TEST(TDynamicMatrix, binary_load_detects_corruption)
+{
+	TDynamicMatrix<int64_t> m(40);
+	for (int i = 0; i < 40; i++)
+		m[i][i] = i;
+	const char* path = "test_tmatrix_bin_bad.tmp";
+	save_matrix_binary(path, m);
+	{
+		fstream f(path, ios::in | ios::out | ios::binary);
+		f.seekp(sizeof(TBinaryHeader) + 1000);
+		f.put('\x7f');
+	}
+	ASSERT_NO_THROW(load_matrix_binary<int64_t>(path));
+	ASSERT_ANY_THROW(load_matrix_binary<int64_t>(path, true));
+	{
+		ofstream f(path, ios::binary);
+		f << "not a matrix at all, just some text to fill the header space........";
+	}
+	ASSERT_ANY_THROW(load_matrix_binary<int64_t>(path));
+	remove(path);
+}
+
+TEST(TDynamicMatrix, npy_round_trip_is_zero_copy)
+{
+	int n = 50;
+	TDynamicMatrix<double> m(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			m[i][j] = i - j * 0.125;
+	const char* path = "test_tmatrix_npy.tmp";
+	save_npy(path, m);
+	std::vector<char> raw = read_file(path);
+	string head(raw.data() + 10, 64);
+	EXPECT_EQ(0u, (raw.size() - n * n * sizeof(double)) % 64);
+	EXPECT_EQ(0u, head.find("{'descr': '<f8', 'fortran_order': False, 'shape': (50, 50), }"));
+	TDynamicMatrix<double> r = load_npy_matrix<double>(path);
+#ifndef _WIN32
+	EXPECT_TRUE(r.is_view());
+#endif
+	EXPECT_EQ(m, r);
+	TDynamicMatrix<int> c = load_npy_matrix<int>(path);
+	EXPECT_EQ(-6, c[0][49]);
+	ASSERT_ANY_THROW(load_npy_vector<double>(path));
+	remove(path);
+}
+
+TEST(TDynamicMatrix, npy_load_converts_fortran_big_endian_data)
+{
+	const char* path = "test_tmatrix_npy_f.tmp";
+	{
+		ofstream f(path, ios::binary);
+		write_npy_header(f, ">i4", true, { 3, 3 });
+		for (int j = 0; j < 3; j++)
+			for (int i = 0; i < 3; i++) {
+				int v = i * 10 + j - 4;
+				char b[4] = { char(v >> 24), char(v >> 16), char(v >> 8), char(v) };
+				f.write(b, 4);
+			}
+	}
+	TDynamicMatrix<double> r = load_npy_matrix<double>(path);
+	remove(path);
+	EXPECT_FALSE(r.is_view());
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			EXPECT_EQ(i * 10 + j - 4, r[i][j]);
+}
+
+static string zip_of(const std::vector<pair<string, string>>& files, int method = 0)
+{
+	string out, dir;
+	auto put = [](string& s, uint64_t v, int bytes) {
+		for (int i = 0; i < bytes; i++)
+			s += char(v >> (8 * i));
+	};
+	for (auto& f : files) {
+		size_t off = out.size(), sz = f.second.size();
+		put(out, 0x04034b50, 4); put(out, 20, 2); put(out, 0, 2); put(out, method, 2);
+		put(out, 0, 8); put(out, sz, 4); put(out, sz, 4); put(out, f.first.size(), 2); put(out, 0, 2);
+		out += f.first + f.second;
+		put(dir, 0x02014b50, 4); put(dir, 20, 2); put(dir, 20, 2); put(dir, 0, 2); put(dir, method, 2);
+		put(dir, 0, 8); put(dir, sz, 4); put(dir, sz, 4); put(dir, f.first.size(), 2);
+		put(dir, 0, 8); put(dir, 0, 4); put(dir, off, 4);
+		dir += f.first;
+	}
+	size_t start = out.size();
+	out += dir;
+	put(out, 0x06054b50, 4); put(out, 0, 4); put(out, files.size(), 2); put(out, files.size(), 2);
+	put(out, dir.size(), 4); put(out, start, 4); put(out, 0, 2);
+	return out;
+}
+
+TEST(TDynamicMatrix, npz_archive_reads_several_arrays)
+{
+	const char* tmp = "test_tmatrix_npz_part.tmp";
+	TDynamicMatrix<int64_t> a(4);
+	for (int i = 0; i < 4; i++)
+		a[i][3 - i] = i + 1;
+	TDynamicVector<float> b(7);
+	for (int i = 0; i < 7; i++)
+		b[i] = i * 1.5f;
+	save_npy(tmp, a);
+	std::vector<char> ra = read_file(tmp);
+	save_npy(tmp, b);
+	std::vector<char> rb = read_file(tmp);
+	remove(tmp);
+	const char* path = "test_tmatrix_npz.tmp";
+	{
+		ofstream f(path, ios::binary);
+		f << zip_of({ { "a.npy", string(ra.begin(), ra.end()) }, { "weights.npy", string(rb.begin(), rb.end()) } });
+	}
+	{
+		TNpzArchive z(path);
+		std::vector<string> names = z.names();
+		ASSERT_EQ(2, names.size());
+		EXPECT_EQ("a", names[0]);
+		EXPECT_EQ("weights", names[1]);
+		EXPECT_EQ(a, z.matrix<int64_t>("a"));
+		EXPECT_EQ(b, z.vector<float>("weights"));
+		EXPECT_EQ(3.0, z.vector<double>("weights")[2]);
+		ASSERT_ANY_THROW(z.matrix<int64_t>("missing"));
+	}
+	{
+		ofstream f(path, ios::binary);
+		f << zip_of({ { "a.npy", string(ra.begin(), ra.end()) } }, 8);
+	}
+	ASSERT_ANY_THROW(TNpzArchive z(path));
+	remove(path);
+}
+
+TEST(TDynamicMatrix, matrix_market_symmetric_coordinate_expands_lazily)
+{
+	const char* path = "test_tmatrix_mm.tmp";
+	{
+		ofstream f(path);
+		f << "%%MatrixMarket matrix coordinate real symmetric\n"
+			<< "% comment\n"
+			<< "3 3 4\n"
+			<< "1 1 2.5\n"
+			<< "2 1 -1\n"
+			<< "3 2 4\n"
+			<< "3 3 1e1\n";
+	}
+	TSparseMatrix<double> s = load_matrix_market_sparse<double>(path);
+	EXPECT_EQ(4, s.nnz());
+	EXPECT_EQ(TSymmetry::symmetric, s.symmetry());
+	EXPECT_EQ(-1.0, s.at(0, 1));
+	EXPECT_EQ(4.0, s.at(1, 2));
+	EXPECT_EQ(0.0, s.at(0, 2));
+	TDynamicMatrix<double> d = load_matrix_market_dense<double>(path);
+	EXPECT_EQ(d, s.to_dense());
+	EXPECT_EQ(-1.0, d[0][1]);
+	EXPECT_EQ(-1.0, d[1][0]);
+	TDynamicVector<double> x(3);
+	x[0] = 1; x[1] = 2; x[2] = 3;
+	EXPECT_EQ(d * x, s * x);
+	save_matrix_market(path, s);
+	TSparseMatrix<double> r = load_matrix_market_sparse<double>(path);
+	remove(path);
+	EXPECT_EQ(4, r.nnz());
+	EXPECT_EQ(d, r.to_dense());
+}
+
+TEST(TDynamicMatrix, matrix_market_array_and_pattern_formats)
+{
+	const char* path = "test_tmatrix_mm_arr.tmp";
+	{
+		ofstream f(path);
+		f << "%%MatrixMarket matrix array integer skew-symmetric\n3 3\n5\n-2\n7\n";
+	}
+	TDynamicMatrix<int> d = load_matrix_market_dense<int>(path);
+	EXPECT_EQ(5, d[1][0]);
+	EXPECT_EQ(-5, d[0][1]);
+	EXPECT_EQ(-2, d[2][0]);
+	EXPECT_EQ(7, d[2][1]);
+	EXPECT_EQ(0, d[1][1]);
+	EXPECT_EQ(d, load_matrix_market_sparse<int>(path).to_dense());
+	TDynamicMatrix<int> g(3);
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			g[i][j] = i * 3 + j;
+	save_matrix_market(path, g);
+	EXPECT_EQ(g, load_matrix_market_dense<int>(path));
+	{
+		ofstream f(path);
+		f << "%%MatrixMarket matrix coordinate pattern general\n2 2 2\n1 2\n2 1\n";
+	}
+	TSparseMatrix<int> p = load_matrix_market_sparse<int>(path);
+	EXPECT_EQ(1, p.at(0, 1));
+	EXPECT_EQ(0, p.at(0, 0));
+	{
+		ofstream f(path);
+		f << "%%MatrixMarket matrix coordinate real general\n2 2 2\n1 3 1.0\n";
+	}
+	ASSERT_ANY_THROW(load_matrix_market_sparse<double>(path));
+	{
+		ofstream f(path);
+		f << "%%MatrixMarket matrix coordinate complex general\n2 2 0\n";
+	}
+	ASSERT_ANY_THROW(load_matrix_market_sparse<double>(path));
+	remove(path);
+}
+
+TEST(TDynamicMatrix, matrix_market_validates_sizes_before_reading_data)
+{
+	const char* path = "test_tmatrix_mm_size.tmp";
+	const char* bad[] = {
+		"%%MatrixMarket matrix coordinate real general\n0 5 0\n",
+		"%%MatrixMarket matrix coordinate real general\n4 4 17\n1 1 1.0\n",
+		"%%MatrixMarket matrix coordinate real general\n100000000 100000000 4000000000000000\n1 1 1.0\n",
+		"%%MatrixMarket matrix coordinate real general\n18446744073709551615 2 1\n1 1 1.0\n" };
+	for (const char* text : bad) {
+		{
+			ofstream f(path);
+			f << text;
+		}
+		ASSERT_THROW(load_matrix_market_sparse<double>(path), length_error);
+	}
+	{
+		ofstream f(path);
+		f << "%%MatrixMarket matrix array real general\n20000 20000\n1.0\n";
+	}
+	ASSERT_THROW(load_matrix_market_dense<double>(path), length_error);
+	remove(path);
+}
+
+TEST(TDynamicMatrix, sparse_matrix_sums_duplicates_and_multiplies_in_parallel)
+{
+	size_t n = 2000;
+	std::vector<size_t> ri, ci;
+	std::vector<int64_t> v;
+	for (size_t i = 0; i < n; i++) {
+		for (size_t k = 0; k < 3; k++) {
+			ri.push_back(i);
+			ci.push_back((i * 7 + k * 13) % n);
+			v.push_back(int64_t(i + k));
+		}
+		ri.push_back(i);
+		ci.push_back(i * 7 % n);
+		v.push_back(1);
+	}
+	TSparseMatrix<int64_t> s(n, n, TSymmetry::general, ri, ci, v);
+	EXPECT_EQ(3 * n, s.nnz());
+	EXPECT_EQ(int64_t(5 + 1), s.at(5, 35));
+	TDynamicVector<int64_t> x(n);
+	for (size_t i = 0; i < n; i++)
+		x[i] = int64_t(i % 11);
+	set_thread_count(4);
+	TDynamicVector<int64_t> y = s * x;
+	set_thread_count(0);
+	for (size_t i = 0; i < n; i += 97) {
+		int64_t e = 0;
+		for (size_t k = 0; k < 3; k++)
+			e += int64_t(i + k + (k == 0)) * x[(i * 7 + k * 13) % n];
+		EXPECT_EQ(e, y[i]);
+	}
+}
+
+TEST(TDynamicMatrix, out_of_core_gemm_matches_in_memory_product)
+{
+	int n = 37;
+	TDynamicMatrix<int64_t> a(n), b(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++) {
+			a[i][j] = (i * 7 + j * 3) % 11 - 5;
+			b[i][j] = (i * 5 + j * 13) % 9 - 4;
+		}
+	TDynamicMatrix<int64_t> ref = a * b;
+	size_t tile_bytes = 8 * 8 * sizeof(int64_t);
+	{
+		TTiledMatrix<int64_t> ta("test_ooc_a.tmp", n, 8), tb("test_ooc_b.tmp", n, 8), tc("test_ooc_c.tmp", n, 8);
+		EXPECT_EQ(5, ta.tiles());
+		ta.assign(a);
+		tb.assign(b);
+		set_thread_count(3);
+		TOutOfCoreStats small = gemm_out_of_core(tc, ta, tb, 6 * tile_bytes);
+		set_thread_count(0);
+		EXPECT_EQ(250, small.tile_reads);
+		EXPECT_EQ(25, small.tile_writes);
+		EXPECT_EQ(ref, tc.to_dense());
+		TOutOfCoreStats big = gemm_out_of_core(tc, ta, tb, 64 * tile_bytes);
+		EXPECT_EQ(150, big.tile_reads);
+		EXPECT_EQ(ref, tc.to_dense());
+		ASSERT_ANY_THROW(gemm_out_of_core(tc, ta, tb, 5 * tile_bytes));
+		ASSERT_ANY_THROW(gemm_out_of_core(ta, ta, tb, 64 * tile_bytes));
+	}
+	{
+		TTiledMatrix<int64_t> tc("test_ooc_c.tmp");
+		EXPECT_EQ(size_t(n), tc.size());
+		EXPECT_EQ(ref[36][20], tc.get(36, 20));
+		tc.set(36, 20, 1);
+		EXPECT_EQ(1, tc.get(36, 20));
+		ASSERT_ANY_THROW(tc.get(37, 0));
+	}
+	{
+		TTiledMatrix<int64_t> ta("test_ooc_a.tmp", false), tc("test_ooc_c.tmp", false);
+		EXPECT_FALSE(tc.is_writable());
+		EXPECT_EQ(1, tc.get(36, 20));
+		ASSERT_ANY_THROW(tc.set(36, 20, 2));
+		ASSERT_ANY_THROW(tc.write_tile(0, 0, tc.make_tile()));
+		ASSERT_ANY_THROW(gemm_out_of_core(tc, ta, ta, 64 * tile_bytes));
+		EXPECT_EQ(1, tc.get(36, 20));
+	}
+	ASSERT_ANY_THROW(TTiledMatrix<int64_t>("no_such_dir/test_ooc.tmp", n, 8));
+	ASSERT_ANY_THROW(TTiledMatrix<double>("test_ooc_c.tmp"));
+	ASSERT_ANY_THROW(load_matrix_binary<int64_t>("test_ooc_c.tmp"));
+	remove("test_ooc_a.tmp");
+	remove("test_ooc_b.tmp");
+	remove("test_ooc_c.tmp");
+}
+
+#ifndef _WIN32
+TEST(TDynamicMatrix, mapped_matrix_writes_through_to_file)
+{
+	const char* path = "test_tmatrix_mapped.tmp";
+	int n = 20;
+	TDynamicMatrix<double> a(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			a[i][j] = i + j * 0.5;
+	{
+		TMappedMatrix<double> file = TMappedMatrix<double>::create(path, n, TAccessHint::sequential);
+		TDynamicMatrix<double>& m = file.matrix();
+		EXPECT_TRUE(m.is_view());
+		EXPECT_EQ(TDynamicMatrix<double>(n), m);
+		m = a * a;
+		m[0][0] = -1.0;
+		EXPECT_TRUE(m.is_view());
+		TMappedMatrix<double> other(path, false, TAccessHint::random);
+		EXPECT_EQ(-1.0, other.view()[0][0]);
+		EXPECT_EQ(m, other.view());
+		ASSERT_ANY_THROW(other.matrix());
+		file.sync();
+	}
+	TDynamicMatrix<double> r = load_matrix_binary<double>(path, true);
+	TDynamicMatrix<double> e = a * a;
+	e[0][0] = -1.0;
+	EXPECT_EQ(e, r);
+	remove(path);
+}
+
+TEST(TDynamicMatrix, mapped_matrix_can_be_moved)
+{
+	const char* path = "test_tmatrix_mapped_move.tmp";
+	{
+		TMappedMatrix<int> file = TMappedMatrix<int>::create(path, 3);
+		file.matrix()[1][2] = 7;
+		TMappedMatrix<int> moved(std::move(file));
+		EXPECT_EQ(0u, file.view().size());
+		EXPECT_EQ(7, moved.view()[1][2]);
+		EXPECT_TRUE(moved.view().is_view());
+		TMappedMatrix<int> other = TMappedMatrix<int>::create(path, 3);
+		other = std::move(moved);
+		EXPECT_FALSE(moved.view().is_view());
+		EXPECT_TRUE(other.view().is_view());
+		EXPECT_EQ(3u, other.view().size());
+	}
+	remove(path);
+}
+
+TEST(TDynamicMatrix, move_into_view_leaves_source_empty)
+{
+	int mem[4] = {};
+	TDynamicMatrix<int> v(mem, 2, shared_ptr<void>(mem, [](void*) {}));
+	TDynamicMatrix<int> a(2);
+	a[1][0] = 5;
+	v = std::move(a);
+	EXPECT_EQ(5, mem[2]);
+	EXPECT_TRUE(v.is_view());
+	EXPECT_EQ(0u, a.size());
+	TDynamicMatrix<int> c(v);
+	EXPECT_FALSE(c.is_view());
+}
+#endif
+
+#ifndef _WIN32
+TEST(TDynamicMatrix, shared_matrix_gives_consumers_zero_copy_view)
+{
+	string name = "tmatrix_test_" + to_string(getpid());
+	{
+		TSharedMatrix<int> producer = TSharedMatrix<int>::create(name, 4);
+		TDynamicMatrix<int>& m = producer.matrix();
+		for (int i = 0; i < 4; i++)
+			m[i][i] = i + 1;
+		EXPECT_EQ(1u, producer.publish());
+		ASSERT_ANY_THROW(TSharedMatrix<int>::create(name, 4));
+		{
+			TSharedMatrix<int> consumer = TSharedMatrix<int>::attach(name);
+			EXPECT_EQ(2u, producer.refs());
+			EXPECT_EQ(1u, consumer.generation());
+			EXPECT_EQ(m, consumer.view());
+			EXPECT_TRUE(consumer.view().is_view());
+			ASSERT_ANY_THROW(consumer.matrix());
+			ASSERT_ANY_THROW(consumer.publish());
+			m = m + m;
+			producer.publish();
+			EXPECT_EQ(2u, consumer.generation());
+			EXPECT_EQ(8, consumer.view()[3][3]);
+			ASSERT_ANY_THROW(TSharedMatrix<double>::attach(name));
+		}
+		EXPECT_EQ(1u, producer.refs());
+	}
+	ASSERT_ANY_THROW(TSharedMatrix<int>::attach(name));
+}
+
+TEST(TDynamicMatrix, shared_matrix_can_be_moved_and_reassigned)
+{
+	string name = "tmatrix_move_" + to_string(getpid());
+	{
+		TSharedMatrix<int> producer = TSharedMatrix<int>::create(name, 3);
+		producer.matrix()[2][1] = 9;
+		std::vector<TSharedMatrix<int>> consumers;
+		consumers.push_back(TSharedMatrix<int>::attach(name));
+		consumers.push_back(TSharedMatrix<int>::attach(name));
+		EXPECT_EQ(3u, producer.refs());
+		TSharedMatrix<int> moved(std::move(producer));
+		EXPECT_TRUE(moved.is_owner());
+		EXPECT_FALSE(producer.is_owner());
+		EXPECT_EQ(3u, moved.refs());
+		consumers[0] = std::move(consumers[1]);
+		consumers.pop_back();
+		EXPECT_EQ(2u, moved.refs());
+		EXPECT_EQ(9, consumers[0].view()[2][1]);
+	}
+	ASSERT_ANY_THROW(TSharedMatrix<int>::attach(name));
+}
+#endif
+
+TEST(TDynamicMatrix, compressed_format_round_trips_and_shrinks_small_range_integers)
+{
+	int n = 400;
+	TDynamicMatrix<int> m(n);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			m[i][j] = 1000 + (i * 31 + j * 17) % 13 - (i % 3 == 0 ? 2000 : 0);
+	const char* path = "test_tmatrix_cmp.tmp";
+	set_thread_count(4);
+	save_matrix_compressed(path, m);
+	TDynamicMatrix<int> r = load_matrix_compressed<int>(path, true);
+	set_thread_count(0);
+	EXPECT_EQ(m, r);
+	size_t packed = read_file(path).size();
+	EXPECT_LT(packed * 4, size_t(n) * n * sizeof(int));
+	ASSERT_ANY_THROW(load_matrix_compressed<int64_t>(path));
+	ASSERT_ANY_THROW(load_vector_compressed<int>(path));
+	ASSERT_ANY_THROW(load_matrix_binary<int>(path));
+	{
+		fstream f(path, ios::in | ios::out | ios::binary);
+		uint64_t first = 0;
+		f.seekg(sizeof(TBinaryHeader));
+		f.read(reinterpret_cast<char*>(&first), sizeof(first));
+		f.seekp(first + 2);
+		f.put('\x55');
+	}
+	ASSERT_ANY_THROW(load_matrix_compressed<int>(path, true));
+	remove(path);
+}
+
+TEST(TDynamicMatrix, compressed_format_is_lossless_for_any_values)
+{
+	int n = 64;
+	TDynamicMatrix<double> d(n);
+	TDynamicMatrix<uint64_t> u(n);
+	uint64_t x = 88172645463325252ULL;
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++) {
+			x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+			u[i][j] = x;
+			d[i][j] = (j % 5 == 0 ? -1.0 : 1.0) * double(x >> 11) * 1e-300 * (i + 1);
+		}
+	d[0][0] = -0.0;
+	d[0][1] = numeric_limits<double>::infinity();
+	d[0][2] = numeric_limits<double>::denorm_min();
+	const char* path = "test_tmatrix_cmp_any.tmp";
+	save_matrix_compressed(path, d);
+	TDynamicMatrix<double> rd = load_matrix_compressed<double>(path, true);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			ASSERT_EQ(0, memcmp(&d[i][j], &rd[i][j], sizeof(double)));
+	save_matrix_compressed(path, u);
+	EXPECT_EQ(u, load_matrix_compressed<uint64_t>(path, true));
+	remove(path);
+}
+
+TEST(TDynamicMatrix, pipeline_keeps_job_order_and_counts_stages)
+{
+	size_t jobs = 40;
+	std::vector<int> written;
+	set_thread_count(3);
+	TPipelineStats st = run_pipeline(jobs,
+		[](size_t i) { return int(i); },
+		[](int& x) { return x * x; },
+		[&](size_t i, int& y) { EXPECT_EQ(int(i * i), y); written.push_back(y); },
+		2);
+	set_thread_count(0);
+	ASSERT_EQ(jobs, written.size());
+	EXPECT_EQ(jobs, st.read.items);
+	EXPECT_EQ(jobs, st.compute.items);
+	EXPECT_EQ(jobs, st.write.items);
+	EXPECT_GE(st.wall, 0.0);
+	ostringstream os;
+	os << st;
+	EXPECT_NE(string::npos, os.str().find("bottleneck"));
+}
+
+TEST(TDynamicMatrix, pipeline_stops_and_rethrows_on_stage_error)
+{
+	size_t computed = 0;
+	ASSERT_ANY_THROW(run_pipeline(1000,
+		[](size_t i) { return i; },
+		[&](size_t& x) { computed++; return x; },
+		[](size_t i, size_t&) { if (i == 3) throw runtime_error("disk full"); },
+		2));
+	EXPECT_LT(computed, 1000u);
+	ASSERT_ANY_THROW(run_pipeline(10,
+		[](size_t i) { if (i == 5) throw runtime_error("bad file"); return i; },
+		[](size_t& x) { return x; },
+		[](size_t, size_t&) {}));
+}
+
+TEST(TDynamicMatrix, pipeline_does_not_write_after_stage_error)
+{
+	// запись задания 0 начинается до ошибки счета и заканчивается после нее
+	atomic<bool> writing(false), thrown(false);
+	std::vector<size_t> written;
+	ASSERT_ANY_THROW(run_pipeline(10,
+		[](size_t i) { return i; },
+		[&](size_t& x) {
+			if (x == 4) {
+				while (!writing)
+					this_thread::yield();
+				thrown = true;
+				throw runtime_error("bad job");
+			}
+			return x;
+		},
+		[&](size_t i, size_t&) {
+			writing = true;
+			while (i == 0 && !thrown)
+				this_thread::yield();
+			if (i == 0)
+				this_thread::sleep_for(chrono::milliseconds(50));
+			written.push_back(i);
+		},
+		4));
+	ASSERT_EQ(1u, written.size());
+	EXPECT_EQ(0u, written[0]);
+}
+
+TEST(TDynamicMatrix, batch_runs_jobs_from_file)
+{
+	TDynamicMatrix<int> a(6), b(6);
+	for (int i = 0; i < 6; i++)
+		for (int j = 0; j < 6; j++) {
+			a[i][j] = i - j;
+			b[i][j] = i * j % 5;
+		}
+	save_matrix_binary("test_batch_a.tmp", a);
+	save_matrix_binary("test_batch_b.tmp", b);
+	{
+		ofstream f("test_batch_jobs.tmp");
+		f << "# op a b out\n"
+			<< "m test_batch_a.tmp test_batch_b.tmp test_batch_m.tmp\n\n"
+			<< "p test_batch_a.tmp test_batch_b.tmp test_batch_p.tmp\n"
+			<< "d test_batch_b.tmp test_batch_a.tmp test_batch_d.tmp\n";
+	}
+	std::vector<TBatchJob> jobs = load_batch_jobs("test_batch_jobs.tmp");
+	ASSERT_EQ(3, jobs.size());
+	TPipelineStats st = run_batch<int>(jobs);
+	EXPECT_EQ(3, st.write.items);
+	EXPECT_EQ(a * b, load_matrix_binary<int>("test_batch_m.tmp"));
+	EXPECT_EQ(a + b, load_matrix_binary<int>("test_batch_p.tmp"));
+	EXPECT_EQ(b - a, load_matrix_binary<int>("test_batch_d.tmp"));
+	{
+		ofstream f("test_batch_jobs.tmp");
+		f << "x test_batch_a.tmp test_batch_b.tmp out.tmp\n";
+	}
+	ASSERT_ANY_THROW(load_batch_jobs("test_batch_jobs.tmp"));
+	jobs[0].a = "no_such_file.tmp";
+	ASSERT_ANY_THROW(run_batch<int>(jobs));
+	for (const char* p : { "test_batch_a.tmp", "test_batch_b.tmp", "test_batch_jobs.tmp", "test_batch_m.tmp",
+		"test_batch_p.tmp", "test_batch_d.tmp" })
+		remove(p);
+}
+
+TEST(TDynamicMatrix, binary_load_rejects_huge_data_offset)
+{
+	TDynamicMatrix<int> m(3);
+	const char* path = "test_tmatrix_bin_off.tmp";
+	save_matrix_binary(path, m);
+	{
+		fstream f(path, ios::in | ios::out | ios::binary);
+		TBinaryHeader h;
+		f.read(reinterpret_cast<char*>(&h), sizeof(h));
+		h.data_offset = ~uint64_t(0) - 15;
+		f.seekp(0);
+		f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	}
+	ASSERT_ANY_THROW(load_matrix_binary<int>(path));
+	remove(path);
+}
+
+TEST(TDynamicMatrix, compressed_load_rejects_bad_block_header)
+{
+	TDynamicVector<int> v(100);
+	for (int i = 0; i < 100; i++)
+		v[i] = i % 7;
+	const char* path = "test_tmatrix_cmp_hdr.tmp";
+	save_vector_compressed(path, v);
+	TBinaryHeader h;
+	{
+		fstream f(path, ios::in | ios::out | ios::binary);
+		f.read(reinterpret_cast<char*>(&h), sizeof(h));
+		h.reserved = uint64_t(1) << 60;
+		f.seekp(0);
+		f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	}
+	EXPECT_EQ(v, load_vector_compressed<int>(path, true));
+	{
+		fstream f(path, ios::in | ios::out | ios::binary);
+		h.data_offset = ~uint64_t(0) - 7;
+		f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	}
+	ASSERT_ANY_THROW(load_vector_compressed<int>(path));
+	remove(path);
+}
+
+TEST(TDynamicMatrix, npy_load_rejects_truncated_header)
+{
+	const char* path = "test_tmatrix_npy_cut.tmp";
+	{
+		ofstream f(path, ios::binary);
+		string dict = "{'descr':";
+		f.write("\x93NUMPY\x01\x00", 8);
+		f.put(char(dict.size()));
+		f.put(0);
+		f << dict;
+	}
+	ASSERT_ANY_THROW(load_npy_matrix<double>(path));
+	remove(path);
+}
@@ -1,4 +1,5 @@
 #include "tmatrix.h"
+#include <sstream>
 #include <gtest.h>
 TEST(TDynamicVector, can_create_vector_with_positive_length)
 {
@@ -283,3 +284,269 @@ TEST(TDynamicVector, initialization_constructor_overload)
 			check = 0;
 	EXPECT_EQ(1, check);
 }
+
+TEST(TDynamicVector, float_vectors_equal_within_few_ulps)
+{
+	TDynamicVector<double> a(3), b(3);
+	a[0] = 0.1 + 0.2; b[0] = 0.3;
+	a[1] = 1e20; b[1] = 1e20;
+	a[2] = -0.0; b[2] = 0.0;
+	EXPECT_EQ(a, b);
+}
+
+TEST(TDynamicVector, small_float_values_are_compared_relatively)
+{
+	TDynamicVector<double> a(1), b(1);
+	a[0] = 1e-30; b[0] = 2e-30;
+	EXPECT_NE(a, b);
+	EXPECT_TRUE(approx_equal(a, b, TTolerance(1e-20)));
+}
+
+TEST(TDynamicVector, nan_is_not_equal_to_itself)
+{
+	TDynamicVector<float> a(2);
+	a[1] = numeric_limits<float>::quiet_NaN();
+	TDynamicVector<float> b(a);
+	EXPECT_NE(a, b);
+}
+
+TEST(TDynamicVector, approx_equal_with_relative_tolerance)
+{
+	int n = 100000;
+	TDynamicVector<float> a(n), b(n);
+	for (int i = 0; i < n; i++) {
+		a[i] = 1000.0f + i;
+		b[i] = a[i] * (1 + 1e-5f);
+	}
+	EXPECT_NE(a, b);
+	EXPECT_TRUE(approx_equal(a, b, TTolerance(0, 1e-4)));
+	b[n - 1] = 0;
+	EXPECT_FALSE(approx_equal(a, b, TTolerance(0, 1e-4)));
+}
+
+TEST(TDynamicVector, diff_respects_tolerance)
+{
+	int n = 5000;
+	TDynamicVector<float> a(n), b(n);
+	for (int i = 0; i < n; i++)
+		a[i] = b[i] = 1.0f;
+	b[4000] = 1.001f;
+	EXPECT_EQ(1, diff(a, b).count);
+	EXPECT_EQ(4000, diff(a, b).first);
+	EXPECT_EQ(0, diff(a, b, TTolerance(0, 1e-2)).count);
+	EXPECT_EQ(4000, diff(a, b, TTolerance(0, 1e-2)).max_abs_pos);
+}
+
+TEST(TDynamicVector, can_compute_norms)
+{
+	TDynamicVector<int> v(4);
+	v[0] = 3; v[1] = -4; v[2] = 0; v[3] = 2;
+	EXPECT_EQ(1, sum(v));
+	EXPECT_EQ(9, norm1(v));
+	EXPECT_NEAR(sqrt(29.0), norm2(v), 1e-12);
+	EXPECT_EQ(4, norm_inf(v));
+	EXPECT_EQ(-4, min_value(v));
+	EXPECT_EQ(3, max_value(v));
+	EXPECT_EQ(0, argmax(v));
+}
+
+TEST(TDynamicVector, reproducible_sum_does_not_depend_on_thread_count)
+{
+	int n = 1000003;
+	TDynamicVector<float> v(n);
+	for (int i = 0; i < n; i++)
+		v[i] = 1.0f / (1 + i % 1000) * (i % 3 ? 1 : -1);
+	set_thread_count(1);
+	float s1 = sum(v, TReduceMode::reproducible);
+	float f1 = norm2(v, TReduceMode::reproducible);
+	set_thread_count(3);
+	float s3 = sum(v, TReduceMode::reproducible);
+	float f3 = norm2(v, TReduceMode::reproducible);
+	set_thread_count(0);
+	EXPECT_EQ(0, memcmp(&s1, &s3, sizeof(float)));
+	EXPECT_EQ(0, memcmp(&f1, &f3, sizeof(float)));
+	EXPECT_NEAR(s1, sum(v), 1e-2);
+}
+
+TEST(TDynamicVector, argmax_returns_first_of_equal_maxima)
+{
+	int n = 20000;
+	TDynamicVector<double> v(n);
+	v[12345] = 5;
+	v[17000] = 5;
+	EXPECT_EQ(12345, argmax(v));
+}
+
+TEST(TDynamicVector, wide_dot_product_does_not_overflow_int)
+{
+	int n = 1000;
+	TDynamicVector<int> a(n), b(n);
+	for (int i = 0; i < n; i++) {
+		a[i] = 100000;
+		b[i] = 100000;
+	}
+	int64_t r = dot<TWideSum>(a, b);
+	EXPECT_EQ(10000000000000LL, r);
+}
+
+TEST(TDynamicVector, compensated_dot_products_are_accurate)
+{
+	int n = 2000000;
+	TDynamicVector<float> a(n), b(n);
+	double exact = 0;
+	for (int i = 0; i < n; i++) {
+		a[i] = 0.1f + (i % 10) * 1e-3f;
+		b[i] = 1.0f;
+		exact += (double)a[i];
+	}
+	EXPECT_NEAR(exact, dot<TKahanSum>(a, b), exact * 1e-6);
+	EXPECT_NEAR(exact, dot<TPairwiseSum>(a, b), exact * 1e-6);
+	EXPECT_NEAR(exact, dot<TWideSum>(a, b), exact * 1e-9);
+}
+
+TEST(TDynamicVector, cant_dot_vectors_with_not_equal_size)
+{
+	TDynamicVector<int> a(3), b(4);
+	ASSERT_ANY_THROW(dot<TKahanSum>(a, b));
+}
+
+TEST(TDynamicVector, elementwise_math_matches_std)
+{
+	// заявленные границы: exp - 1 ULP, log и tanh - 2 ULP
+	int n = 10000;
+	TDynamicVector<double> v(n), re(n), rt(n), rl(n);
+	for (int i = 0; i < n; i++) {
+		v[i] = (i - n / 2) * 0.013;
+		re[i] = exp(v[i]);
+		rt[i] = tanh(v[i]);
+		rl[i] = log(re[i]);
+	}
+	TDynamicVector<double> e = vexp(v), t = vtanh(v), l = vlog(re);
+	EXPECT_TRUE(approx_equal(re, e, TTolerance(0, 0, 1)));
+	EXPECT_TRUE(approx_equal(rt, t, TTolerance(0, 0, 2)));
+	EXPECT_TRUE(approx_equal(rl, l, TTolerance(0, 0, 2)));
+	TDynamicVector<double> s(n), rs(n);
+	for (int i = 0; i < n; i++) {
+		s[i] = (i - n / 2) * 1e-7;
+		rs[i] = tanh(s[i]);
+	}
+	EXPECT_TRUE(approx_equal(rs, vtanh(s), TTolerance(0, 0, 2)));
+}
+
+TEST(TDynamicVector, elementwise_math_handles_special_values)
+{
+	TDynamicVector<double> v(4);
+	v[0] = 0; v[1] = -1; v[2] = numeric_limits<double>::infinity(); v[3] = 1e-310;
+	TDynamicVector<double> l = vlog(v);
+	EXPECT_EQ(-numeric_limits<double>::infinity(), l[0]);
+	EXPECT_TRUE(l[1] != l[1]);
+	EXPECT_EQ(numeric_limits<double>::infinity(), l[2]);
+	EXPECT_NEAR(log(1e-310), l[3], 1e-12);
+	EXPECT_EQ(0, fast_exp(-1000));
+	EXPECT_EQ(numeric_limits<double>::infinity(), fast_exp(1000));
+	EXPECT_EQ(1, fast_tanh(1000));
+}
+
+TEST(TDynamicVector, elementwise_sqrt_and_pow_of_float_vector)
+{
+	TDynamicVector<float> v(3);
+	v[0] = 4; v[1] = 2.25f; v[2] = 0;
+	TDynamicVector<float> s = vsqrt(v), p = vpow(v, 1.5);
+	EXPECT_EQ(2, s[0]);
+	EXPECT_EQ(1.5f, s[1]);
+	EXPECT_FLOAT_EQ(8, p[0]);
+	EXPECT_FLOAT_EQ(3.375f, p[1]);
+	EXPECT_EQ(0, p[2]);
+}
+
+TEST(TDynamicVector, can_map_zip_and_transform_with_all_policies)
+{
+	int n = 100000;
+	TDynamicVector<int> a(n), b(n);
+	for (int i = 0; i < n; i++) {
+		a[i] = i;
+		b[i] = 2 * i;
+	}
+	set_thread_count(3);
+	TExecution ex[3] = { TExecution::seq, TExecution::unseq, TExecution::par };
+	for (int e = 0; e < 3; e++) {
+		TDynamicVector<double> h = a.map([](int x) { return x * 0.5; }, ex[e]);
+		TDynamicVector<int> s = a.zip(b, [](int x, int y) { return y - x; }, ex[e]);
+		TDynamicVector<int> c(a);
+		c.transform([](int x) { return x < 10 ? 10 : x; }, ex[e]);
+		EXPECT_EQ(a, s);
+		for (int i = 0; i < n; i += 997) {
+			EXPECT_EQ(i * 0.5, h[i]);
+			EXPECT_EQ(i < 10 ? 10 : i, c[i]);
+		}
+	}
+	set_thread_count(0);
+}
+
+TEST(TDynamicVector, cant_zip_vectors_with_not_equal_size)
+{
+	TDynamicVector<int> a(3), b(4);
+	ASSERT_ANY_THROW(a.zip(b, [](int x, int y) { return x + y; }));
+}
+
+TEST(TDynamicVector, can_parse_vector_text_across_lines)
+{
+	string text = "1 2 3\n\n4\n  5 6  \n";
+	set_thread_count(3);
+	TDynamicVector<int64_t> v = parse_vector<int64_t>(text.data(), text.size());
+	set_thread_count(0);
+	ASSERT_EQ(6, v.size());
+	for (int i = 0; i < 6; i++)
+		EXPECT_EQ(i + 1, v[i]);
+	string junk = "1 2 z";
+	ASSERT_ANY_THROW(parse_vector<int>(junk.data(), junk.size()));
+}
+
+TEST(TDynamicVector, write_vector_text_formats_one_line)
+{
+	TDynamicVector<int> v(4);
+	v[0] = -3; v[1] = 0; v[2] = 12; v[3] = 7;
+	ostringstream os;
+	write_vector_text(os, v);
+	EXPECT_EQ("-3 0 12 7\n", os.str());
+}
+
+TEST(TDynamicVector, binary_round_trip_and_view_assignment)
+{
+	int n = 3000000;
+	TDynamicVector<float> v(n);
+	for (int i = 0; i < n; i++)
+		v[i] = i * 0.5f;
+	const char* path = "test_tvector_bin.tmp";
+	save_vector_binary(path, v);
+	{
+		TDynamicVector<float> r = load_vector_binary<float>(path, true);
+		EXPECT_EQ(v, r);
+		r = v * 2.0f;
+		EXPECT_EQ(v[n - 1] * 2.0f, r[n - 1]);
+		TDynamicVector<float> small(3);
+		r = small;
+		EXPECT_FALSE(r.is_view());
+		EXPECT_EQ(3, r.size());
+	}
+	EXPECT_EQ(v, load_vector_binary<float>(path));
+	remove(path);
+}
+
+TEST(TDynamicVector, compressed_vector_shrinks_smooth_floats)
+{
+	int n = 300000;
+	TDynamicVector<double> v(n);
+	for (int i = 0; i < n; i++)
+		v[i] = 1000.0 * sin(i * 1e-4);
+	const char* path = "test_tvector_cmp.tmp";
+	save_vector_compressed(path, v);
+	EXPECT_EQ(v, load_vector_compressed<double>(path, true));
+	EXPECT_LT(read_file(path).size() * 3 / 2, n * sizeof(double));
+	TDynamicVector<int16_t> s(1000);
+	for (int i = 0; i < 1000; i++)
+		s[i] = int16_t(i * 37 - 20000);
+	save_vector_compressed(path, s);
+	EXPECT_EQ(s, load_vector_compressed<int16_t>(path));
+	remove(path);
+}